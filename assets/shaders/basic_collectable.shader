@@ -4,24 +4,52 @@
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec3 norm;
 layout(location = 2) in vec2 tex_coords;
+//Drops in the world are instanced: position and rotation around Y, then the item type
+layout(location = 3) in vec4 instance_transform;
+layout(location = 4) in float instance_type;
 
-uniform mat4 proj;
-uniform mat4 view;
+//Camera and light matrices of the frame, shared by the world shaders
+layout(std140) uniform Matrices
+{
+	mat4 view;
+	mat4 proj;
+	mat4 light_space;
+};
+//Used by the held item, which is not instanced
 uniform mat4 model;
+uniform int drop_texture_index;
+uniform int instanced;
 
 out vec2 TexCoords;
+flat out int TextureIndex;
 
 void main() {
 	TexCoords = tex_coords;
-	gl_Position = proj * view * model * vec4(pos, 1.0f);
+
+	vec4 world_pos;
+	if (instanced != 0) {
+		//Same transform of translate * rotate(Y) * scale(0.4)
+		float c = cos(instance_transform.w);
+		float s = sin(instance_transform.w);
+		vec3 scaled = pos * 0.4f;
+		world_pos = vec4(c * scaled.x + s * scaled.z, scaled.y, c * scaled.z - s * scaled.x, 1.0f);
+		world_pos.xyz += instance_transform.xyz;
+		TextureIndex = int(instance_type + 0.5f);
+	}
+	else {
+		world_pos = model * vec4(pos, 1.0f);
+		TextureIndex = drop_texture_index;
+	}
+
+	gl_Position = proj * view * world_pos;
 }
 
 #shader fragment
 #version 330 core
 
 in vec2 TexCoords;
+flat in int TextureIndex;
 
-uniform int drop_texture_index;
 uniform sampler2D global_texture;
 uniform vec2 item_offsets[10];
 
@@ -29,7 +57,5 @@ out vec4 OutColor;
 
 void main() 
 {
-	OutColor = texture(global_texture, TexCoords + item_offsets[drop_texture_index]);
-	//OutColor = vec4(get_offset(drop_texture_index), 0.0f, 1.0f);
+	OutColor = texture(global_texture, TexCoords + item_offsets[TextureIndex]);
 }
-
@@ -1,28 +1,59 @@
 #shader vertex
 #version 330 core
+#extension GL_ARB_shader_draw_parameters : enable
 
-layout(location = 0) in vec3 position;
+layout(location = 0) in float corner;
 
 uniform mat4 lightSpace;
+//Data of each chunk draw: origin x, origin z, selected block (position bits, -1 if there is none)
+uniform isamplerBuffer draw_data;
+//Index of the draw in draw_data, the draws of a multi draw are offset by gl_DrawIDARB
+uniform int draw_base;
 
-//Still instanced
-in vec3 model_depth_pos;
+//Still instanced, one packed instance per cube face (same format of scene.shader)
+layout(location = 1) in uint instance_data;
+
+//Four corners for each face in the block normal order: +X, -X, +Y, -Y, +Z, -Z
+const vec3 face_corners[24] = vec3[24](
+	vec3(0.5f, 0.5f, 0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, -0.5f), vec3(-0.5f, -0.5f, -0.5f), vec3(-0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, 0.5f), vec3(-0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, 0.5f), vec3(0.5f, -0.5f, 0.5f), vec3(0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(-0.5f, 0.5f, -0.5f));
+
+//World axes of the quad width and height for each face
+const ivec2 face_plane_axes[6] = ivec2[6](
+	ivec2(2, 1), ivec2(2, 1), ivec2(0, 2), ivec2(0, 2), ivec2(0, 1), ivec2(0, 1));
 
 void main()
 {
-	mat4 model_matrix = mat4(
-		vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		vec4(model_depth_pos, 1.0f));
+#ifdef GL_ARB_shader_draw_parameters
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base + gl_DrawIDARB);
+#else
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base);
+#endif
+	vec2 chunk_origin = vec2(chunk_draw.xy);
+
+	vec3 model_depth_pos = vec3(
+		chunk_origin.x + float(instance_data & 15u),
+		float((instance_data >> 8u) & 255u),
+		chunk_origin.y + float((instance_data >> 4u) & 15u));
+	int face = int((instance_data >> 16u) & 7u);
+
+	//Greedy quads are stretched from their first block
+	vec3 extent = vec3(1.0f);
+	extent[face_plane_axes[face].x] = float(((instance_data >> 23u) & 15u) + 1u);
+	extent[face_plane_axes[face].y] = float(((instance_data >> 27u) & 15u) + 1u);
 
-	gl_Position = lightSpace * model_matrix * vec4(position, 1.0f);
+	vec3 position = (face_corners[face * 4 + int(corner)] + 0.5f) * extent - 0.5f;
+	gl_Position = lightSpace * vec4(model_depth_pos + position, 1.0f);
 }
 
 #shader fragment
 #version 330 core
 
+//Depth only, leaving gl_FragDepth untouched keeps the early depth test and the polygon offset of the prepass
 void main()
 {
-	gl_FragDepth = gl_FragCoord.z;
 }
\ No newline at end of file
@@ -1,52 +1,112 @@
 #shader vertex
 #version 330 core
+#extension GL_ARB_shader_draw_parameters : enable
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec2 tex_coords;
+layout(location = 0) in float corner;
 
-in vec3 model_pos;
-in uint tex_index;
+//Packed face: local x (4 bits), local z (4 bits), y (8 bits), face (3 bits),
+//texture index (4 bits), quad width - 1 and height - 1 (4 bits each)
+layout(location = 1) in uint instance_data;
 
-uniform mat4 view;
-uniform mat4 proj;
-uniform mat4 light_space;
-
-out vec2 TexCoords;
+//Data of each chunk draw: origin x, origin z, selected block (position bits, -1 if there is none)
+uniform isamplerBuffer draw_data;
+//Index of the draw in draw_data, the draws of a multi draw are offset by gl_DrawIDARB
+uniform int draw_base;
+//Camera and light matrices of the frame, shared by the world shaders
+layout(std140) uniform Matrices
+{
+	mat4 view;
+	mat4 proj;
+	mat4 light_space;
+};
+//Side of the world area wrapped over the tiled shadow map
+uniform vec2 shadow_extent;
+
+//Texture coordinates in blocks, repeated for each block covered by the quad
+out vec2 TileCoords;
+flat out vec2 TileBase;
 flat out uint TexIndex;
+flat out int SelectedInstance;
+flat out int SelectedBlock;
+//Position in chunk space, pushed inside the block the face belongs to
+out vec3 LocalPos;
 out vec3 Norm;
 out vec4 LightSpacePos;
+out vec2 ShadowCoords;
+
+//Faces in the block normal order: +X, -X, +Y, -Y, +Z, -Z
+const vec3 face_normals[6] = vec3[6](
+	vec3(1.0f, 0.0f, 0.0f), vec3(-1.0f, 0.0f, 0.0f),
+	vec3(0.0f, 1.0f, 0.0f), vec3(0.0f, -1.0f, 0.0f),
+	vec3(0.0f, 0.0f, 1.0f), vec3(0.0f, 0.0f, -1.0f));
+
+//Four corners for each face, same positions and texture coordinates of the cube mesh
+const vec3 face_corners[24] = vec3[24](
+	vec3(0.5f, 0.5f, 0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, -0.5f), vec3(-0.5f, -0.5f, -0.5f), vec3(-0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, 0.5f), vec3(-0.5f, -0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, 0.5f), vec3(0.5f, -0.5f, 0.5f), vec3(0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f),
+	vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(0.5f, 0.5f, -0.5f), vec3(-0.5f, 0.5f, -0.5f));
+
+//In texture atlas cells, 16 cells per row
+const vec2 face_tex_coords[24] = vec2[24](
+	vec2(2.0f, 1.0f), vec2(2.0f, 0.0f), vec2(3.0f, 0.0f), vec2(3.0f, 1.0f),
+	vec2(2.0f, 1.0f), vec2(2.0f, 0.0f), vec2(3.0f, 0.0f), vec2(3.0f, 1.0f),
+	vec2(1.0f, 0.0f), vec2(2.0f, 0.0f), vec2(2.0f, 1.0f), vec2(1.0f, 1.0f),
+	vec2(3.0f, 0.0f), vec2(4.0f, 0.0f), vec2(4.0f, 1.0f), vec2(3.0f, 1.0f),
+	vec2(0.0f, 1.0f), vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f),
+	vec2(0.0f, 1.0f), vec2(0.0f, 0.0f), vec2(1.0f, 0.0f), vec2(1.0f, 1.0f));
+//Atlas cell of each face
+const vec2 face_tex_base[6] = vec2[6](
+	vec2(2.0f, 0.0f), vec2(2.0f, 0.0f), vec2(1.0f, 0.0f), vec2(3.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f));
+//World axes of the quad width and height for each face
+const ivec2 face_plane_axes[6] = ivec2[6](
+	ivec2(2, 1), ivec2(2, 1), ivec2(0, 2), ivec2(0, 2), ivec2(0, 1), ivec2(0, 1));
+//World axes followed by the two texture coordinates for each face
+const ivec2 face_tex_axes[6] = ivec2[6](
+	ivec2(1, 2), ivec2(1, 2), ivec2(0, 2), ivec2(0, 2), ivec2(1, 0), ivec2(1, 0));
 
 void main()
 {
-	TexCoords = tex_coords;
-	TexIndex = tex_index;
-	Norm = normalize(norm);
-
-	//A translation matrix without other transformations is just an identity matrix
-	//with the 3D position written in the first 3 slots of the fourth column
-	mat4 model_matrix = mat4(
-		vec4(1.0f, 0.0f, 0.0f, 0.0f), 	//Column 1
-		vec4(0.0f, 1.0f, 0.0f, 0.0f), 	//Column 2 
-		vec4(0.0f, 0.0f, 1.0f, 0.0f), 	//Column 3
-		vec4(model_pos, 1.0f));		//Column 4
-
-	//Scale selection
-	if (int(TexIndex) >= 256)
-	{
-		float fact = 1.05f;
-
-		mat4 scale_matrix = mat4(
-			vec4(fact, 0.0f, 0.0f, 0.0f),
-			vec4(0.0f, fact, 0.0f, 0.0f),
-			vec4(0.0f, 0.0f, fact, 0.0f),
-			vec4(0.0f, 0.0f, 0.0f, 1.0f));
-
-		model_matrix = model_matrix * scale_matrix;
-	}
-
-	vec4 ws_pos = model_matrix * vec4(pos, 1.0f);
+#ifdef GL_ARB_shader_draw_parameters
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base + gl_DrawIDARB);
+#else
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base);
+#endif
+	vec2 chunk_origin = vec2(chunk_draw.xy);
+	int selected_block = chunk_draw.z;
+	SelectedBlock = selected_block;
+
+	vec3 block_pos = vec3(
+		float(instance_data & 15u),
+		float((instance_data >> 8u) & 255u),
+		float((instance_data >> 4u) & 15u));
+	int face = int((instance_data >> 16u) & 7u);
+	int vertex = face * 4 + int(corner);
+
+	//Size of the quad along each axis, 1 along the normal
+	vec3 extent = vec3(1.0f);
+	extent[face_plane_axes[face].x] = float(((instance_data >> 23u) & 15u) + 1u);
+	extent[face_plane_axes[face].y] = float(((instance_data >> 27u) & 15u) + 1u);
+
+	TileBase = face_tex_base[face];
+	TileCoords = (face_tex_coords[vertex] - TileBase) * vec2(extent[face_tex_axes[face].x], extent[face_tex_axes[face].y]);
+	TexIndex = (instance_data >> 19u) & 15u;
+	Norm = face_normals[face];
+
+	//Corners are stretched from the first block of the quad
+	vec3 pos = (face_corners[vertex] + 0.5f) * extent - 0.5f;
+
+	//Scale selection, merged quads are only darkened by the fragment shader
+	SelectedInstance = int(int(instance_data & 0xFF80FFFFu) == selected_block);
+	if (SelectedInstance != 0)
+		pos *= 1.05f;
+
+	LocalPos = block_pos + pos - Norm * 0.25f;
+	vec4 ws_pos = vec4(block_pos + pos + vec3(chunk_origin.x, 0.0f, chunk_origin.y), 1.0f);
 	LightSpacePos = light_space * ws_pos;
+	ShadowCoords = ws_pos.xz / shadow_extent;
 	gl_Position = proj * view * ws_pos;
 }
 
@@ -57,10 +117,15 @@ uniform sampler2D global_texture;
 uniform sampler2D texture_depth;
 uniform vec2 item_offsets[10];
 
-in vec2 TexCoords;
+in vec2 TileCoords;
+flat in vec2 TileBase;
 flat in uint TexIndex;
+flat in int SelectedInstance;
+flat in int SelectedBlock;
+in vec3 LocalPos;
 in vec3 Norm;
 in vec4 LightSpacePos;
+in vec2 ShadowCoords;
 
 out vec4 OutColor;
 
@@ -71,8 +136,15 @@ void main()
 	float darkness_value = 0.4f;
 	float dot_value = dot(Norm, -light_direction);
 	float diff = max(dot_value, darkness_value);
-	OutColor = texture(global_texture, TexCoords + item_offsets[int(TexIndex) % 256]) * diff;
-	OutColor *= int(TexIndex) >= 256 ? 0.4f : 1.0f;
+
+	//Repeat the atlas cell over the quad, the gradients are taken before the wrap to avoid seams
+	vec2 tex_coords = (TileBase + fract(TileCoords)) / 16.0f + item_offsets[TexIndex];
+	OutColor = textureGrad(global_texture, tex_coords, dFdx(TileCoords) / 16.0f, dFdy(TileCoords) / 16.0f) * diff;
+
+	ivec3 cell = ivec3(floor(LocalPos + 0.5f));
+	bool selected = SelectedInstance != 0 ||
+		(SelectedBlock >= 0 && cell == ivec3(SelectedBlock & 15, (SelectedBlock >> 8) & 255, (SelectedBlock >> 4) & 15));
+	OutColor *= selected ? 0.4f : 1.0f;
 
 	//If the fragment is out of the light space, discard the fragment
 	if (LightSpacePos.x < -1.0f || LightSpacePos.y < -1.0f || LightSpacePos.x > 1.0f || LightSpacePos.y > 1.0f)
@@ -81,9 +153,9 @@ void main()
 	//Only apply shadow if the surface is facing the light source to some degree,
 	//otherwise rely only on dot computed diffused lighting
 	if (dot_value > 0.0f) {
-		//compute the [0.0f, 1.0f] vector equivalent
+		//compute the [0.0f, 1.0f] vector equivalent, the shadow map tiles wrap around the world
 		vec3 equiv = (LightSpacePos.xyz + vec3(1.0f)) * 0.5f;
-		float closest_depth = texture(texture_depth, equiv.xy).r;
+		float closest_depth = texture(texture_depth, fract(ShadowCoords)).r;
 		if (equiv.z - closest_depth > 0.001f)
 			OutColor *= darkness_value;
 	}
@@ -1,30 +1,49 @@
 #shader vertex
 #version 330 core
+#extension GL_ARB_shader_draw_parameters : enable
 
-layout(location = 0) in vec3 pos;
-layout(location = 1) in vec3 norm;
-layout(location = 2) in vec2 tex_coords;
+layout(location = 0) in float corner;
+//Merged water rectangle, packed like a +Y block face: local x (4 bits), local z (4 bits), y (8 bits),
+//then width - 1 and depth - 1 of the rectangle in blocks (4 bits each, from bit 23)
+layout(location = 1) in uint instance_data;
 
-in vec3 model_pos;
+//Data of each chunk draw: origin x, origin z, selected block (unused)
+uniform isamplerBuffer draw_data;
+//Index of the draw in draw_data, the draws of a multi draw are offset by gl_DrawIDARB
+uniform int draw_base;
+//Camera and light matrices of the frame, shared by the world shaders
+layout(std140) uniform Matrices
+{
+	mat4 view;
+	mat4 proj;
+	mat4 light_space;
+};
 
-uniform mat4 view;
-uniform mat4 proj;
+//Texture coordinates in blocks, repeated for each block covered by the rectangle
+out vec2 TileCoords;
 
-out vec2 TexCoords;
-out vec3 Norm;
+//Corners of the top face of a block, in the same order of the +Y face of the block shaders
+const vec2 corners[4] = vec2[4](vec2(-0.5f, -0.5f), vec2(0.5f, -0.5f), vec2(0.5f, 0.5f), vec2(-0.5f, 0.5f));
 
 void main()
 {
-	TexCoords = tex_coords;
-	Norm = normalize(norm);
+#ifdef GL_ARB_shader_draw_parameters
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base + gl_DrawIDARB);
+#else
+	ivec4 chunk_draw = texelFetch(draw_data, draw_base);
+#endif
+	vec2 chunk_origin = vec2(chunk_draw.xy);
 
-	mat4 model_matrix = mat4(
-		vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		vec4(model_pos, 1.0f));
+	vec3 first_block = vec3(
+		chunk_origin.x + float(instance_data & 15u),
+		float((instance_data >> 8u) & 255u),
+		chunk_origin.y + float((instance_data >> 4u) & 15u));
+	vec2 extent = vec2(float(((instance_data >> 23u) & 15u) + 1u), float(((instance_data >> 27u) & 15u) + 1u));
 
-	gl_Position = proj * view * model_matrix * vec4(pos, 1.0f);
+	//Stretched from the first block, the surface lies on top of the water block
+	vec2 corner_pos = (corners[int(corner)] + 0.5f) * extent - 0.5f;
+	TileCoords = corner_pos + 0.5f;
+	gl_Position = proj * view * vec4(first_block.x + corner_pos.x, first_block.y + 0.5f, first_block.z + corner_pos.y, 1.0f);
 }
 
 #shader fragment
@@ -32,11 +51,15 @@ void main()
 
 uniform sampler2D global_texture;
 
-in vec2 TexCoords;
-in vec3 Norm;
+in vec2 TileCoords;
 out vec4 OutColor;
 
+//Atlas cell of the water texture, 16 cells per row
+const vec2 water_cell = vec2(1.0f, 1.0f);
+
 void main()
 {
-	OutColor = texture(global_texture, TexCoords);
-}
\ No newline at end of file
+	//Repeat the atlas cell over the rectangle, the gradients are taken before the wrap to avoid seams
+	vec2 tex_coords = (water_cell + fract(TileCoords)) / 16.0f;
+	OutColor = textureGrad(global_texture, tex_coords, dFdx(TileCoords) / 16.0f, dFdy(TileCoords) / 16.0f);
+}
@@ -105,8 +105,23 @@ void Application::OnUserRun()
                     switch_game_state();
                 if (m_Window.IsKeyPressed(GLFW_KEY_F11))
                     display_settings_f11 = !display_settings_f11;
-
-                WorldEvent world_event = world_instance.UpdateScene(game_inventory, elapsed_time);
+                if (m_Window.IsKeyPressed(GLFW_KEY_F10))
+                    GlCore::g_GreedyMeshing = !GlCore::g_GreedyMeshing;
+                if (m_Window.IsKeyPressed(GLFW_KEY_F9))
+                    GlCore::g_MultiDrawIndirect = !GlCore::g_MultiDrawIndirect;
+                if (m_Window.IsKeyPressed(GLFW_KEY_F8))
+                    GlCore::g_OcclusionCulling = !GlCore::g_OcclusionCulling;
+                if (m_Window.IsKeyPressed(GLFW_KEY_F7))
+                    GlCore::g_CaveCulling = !GlCore::g_CaveCulling;
+                if (m_Window.IsKeyPressed(GLFW_KEY_F6))
+                    GlCore::g_HorizonCulling = !GlCore::g_HorizonCulling;
+                if (m_Window.IsKeyPressed(GLFW_KEY_F5))
+                    GlCore::g_DepthPrepass = !GlCore::g_DepthPrepass;
+
+                //The update works on a copy of the camera, the render thread keeps moving it
+                const glm::vec3 camera_position = m_Camera.GetPosition();
+                const glm::vec3 camera_direction = m_Camera.GetFront();
+                WorldEvent world_event = world_instance.UpdateScene(game_inventory, camera_position, camera_direction, elapsed_time);
                 if (world_event.crafting_table_open_command) {
                     game_inventory.view_crafting_table = true;
                     switch_game_state();
@@ -154,7 +169,7 @@ void Application::OnUserRun()
                 if (m_Window.IsKeyPressed(Defs::g_InventoryKey))
                     switch_game_state();
 
-                WorldEvent world_event = world_instance.UpdateScene(game_inventory, elapsed_time);
+                WorldEvent world_event = world_instance.UpdateScene(game_inventory, m_Camera.GetPosition(), m_Camera.GetFront(), elapsed_time);
                 if (world_event.crafting_table_open_command) {
                     game_inventory.view_crafting_table = true;
                     switch_game_state();
@@ -165,12 +180,11 @@ void Application::OnUserRun()
             }
 
             //Rendering ---------------------
-            GlCore::UniformViewMatrix();
-
-            //Copy these vectors to make the camera indipendent from the logic thread
+            //The collision solved by the logic thread is applied before the position is read
+            world_instance.AcquireRenderPacket();
+            //Copy the position to make the camera indipendent from the logic thread
             glm::vec3 camera_position = m_Camera.position;
-            glm::vec3 camera_direction = m_Camera.GetFront();
-            world_instance.Render(game_inventory, camera_position, camera_direction);
+            world_instance.Render(game_inventory, camera_position);
             game_inventory.ScreenRender();
 
             if (Defs::g_ViewMode == Defs::ViewMode::Inventory) {
@@ -193,8 +207,6 @@ void Application::OnUserRun()
                 Physics::HandlePlayerMovement(elapsed_time);
                 if (Defs::g_MovementType != Defs::MovementType::Creative)
                     Physics::HandlePlayerGravity(elapsed_time);
-
-                world_instance.CheckPlayerCollision(camera_position, elapsed_time);
             }
 
             //Timing & logging
@@ -212,6 +224,30 @@ void Application::OnUserRun()
                 info_text_renderer.DrawString("x:" + std::to_string(pos.x) + ", "
                     "y:" + std::to_string(pos.y) + ", " +
                     "z:" + std::to_string(pos.z), { 0,120 });
+                info_text_renderer.DrawString(std::string(GlCore::g_GreedyMeshing ? "Greedy" : "Instanced") + " meshing, triangles:" +
+                    std::to_string(world_instance.RenderedTriangles()), { 0,160 });
+                const GlCore::BlockDrawBatch& block_draws = *state.block_draws;
+                const bool multi_draw = block_draws.MultiDrawSupported() && GlCore::g_MultiDrawIndirect;
+                info_text_renderer.DrawString(std::string(multi_draw ? "Multi draw" : "Single draws") + " submission:" +
+                    std::to_string(block_draws.LastSubmitMilliseconds()) + "ms, draws:" + std::to_string(block_draws.LastDrawCount()), { 0,200 });
+                const u32 tested_chunks = world_instance.TestedChunks();
+                const f32 culled_percentage = tested_chunks > 0 ? 100.0f * world_instance.FrustumCulledChunks() / tested_chunks : 0.0f;
+                info_text_renderer.DrawString("Frustum culled:" + std::to_string(culled_percentage) + "% of " +
+                    std::to_string(tested_chunks) + " chunks", { 0,240 });
+                info_text_renderer.DrawString(std::string(GlCore::g_OcclusionCulling ? "Occluded:" : "Occlusion off, occluded:") +
+                    std::to_string(world_instance.OccludedChunks()) + " chunks in " + std::to_string(world_instance.OcclusionMilliseconds()) + "ms", { 0,280 });
+                info_text_renderer.DrawString(std::string(GlCore::g_CaveCulling ? "Cave culled:" : "Cave culling off, culled:") +
+                    std::to_string(world_instance.CaveCulledChunks()) + " chunks in " + std::to_string(world_instance.CaveMilliseconds()) + "ms", { 0,320 });
+                info_text_renderer.DrawString(std::string(GlCore::g_HorizonCulling ? "Horizon culled:" : "Horizon culling off, culled:") +
+                    std::to_string(world_instance.HorizonCulledChunks()) + " chunks in " + std::to_string(world_instance.HorizonMilliseconds()) + "ms", { 0,360 });
+                info_text_renderer.DrawString(std::string(GlCore::g_DepthPrepass ? "Depth prepass" : "No prepass") + ", shaded samples per pixel:" +
+                    std::to_string(world_instance.ShadedSamplesPerPixel()), { 0,400 });
+                info_text_renderer.DrawString("Drops:" + std::to_string(world_instance.RenderedDrops()) + " drawn of " +
+                    std::to_string(world_instance.DropCount()), { 0,440 });
+                info_text_renderer.DrawString("Water rectangles:" + std::to_string(world_instance.RenderedWaterRects()), { 0,480 });
+                const GlCore::StateCache& state_cache = *state.state_cache;
+                info_text_renderer.DrawString("GL state changes:" + std::to_string(state_cache.LastIssuedChanges()) + " issued, " +
+                    std::to_string(state_cache.LastElidedChanges()) + " redundant skipped", { 0,520 });
             }
 
             m_Window.Update();
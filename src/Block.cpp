@@ -1,8 +1,12 @@
 #include <array>
+#include <algorithm>
+#include <cstddef>
 #include "Shader.h"
 #include "Block.h"
 #include "Vertices.h"
 #include "Chunk.h"
+#include "World.h"
+#include "InventorySystem.h"
 #include "Utils.h"
 
 
@@ -21,35 +25,11 @@ Block::Block(glm::u8vec3 position, const Defs::Item& bt)
 {
 }
 
-void Block::UpdateRenderableSides(const Chunk* parent, const glm::vec3& camera_pos)
-{
-    u8& counter = m_DrawableSides.second;
-    counter = 0;
-
-    //Should never go above 3 elements
-    glm::vec3 dir = parent->ToWorld(position) - camera_pos;
-    for (u32 i = 0; i < bitshifts.size(); i++)
-    {
-        const bool is_norm = exposed_normals & bitshifts[i];
-        if (is_norm)
-        {
-            glm::vec3 norm = NormalForIndex(i);
-            if (counter < 3 && glm::dot(norm, -dir) > 0.0f)
-                m_DrawableSides.first[counter++] = GlCore::GetNormVertexBegin(norm);
-        }
-    }
-}
-
 const Defs::Item& Block::Type() const
 {
     return m_Sprite;
 }
 
-const GlCore::DrawableData& Block::DrawableSides() const
-{
-    return m_DrawableSides;
-}
-
 void Block::AddNormal(const glm::vec3& norm)
 {
     exposed_normals |= (1 << IndexForNormal(norm));
@@ -70,6 +50,14 @@ void Block::RemoveNormal(f32 x, f32 y, f32 z)
     RemoveNormal(glm::vec3(x, y, z));
 }
 
+void Block::SetNormal(u32 index, bool exposed)
+{
+    if (exposed)
+        exposed_normals |= bitshifts[index];
+    else
+        exposed_normals &= ~bitshifts[index];
+}
+
 bool Block::HasNormals() const
 {
     for (u8 i = 0; i < bitshifts.size(); i++)
@@ -79,16 +67,11 @@ bool Block::HasNormals() const
     return false;
 }
 
-bool Block::IsDrawable() const
-{
-    return m_DrawableSides.second;
-}
-
 void Block::Serialize(const Utils::Serializer& sz)
 {
     sz& position.x& position.y& position.z;
     sz& exposed_normals;
-    //m_BlockStructure and m_DrawableData do not need to be serialized
+    //m_BlockStructure does not need to be serialized
 
     sz& static_cast<u8>(m_Sprite);
 }
@@ -132,61 +115,172 @@ glm::vec3 Block::NormalForIndex(u32 index)
     return glm::vec3(0.0f);
 }
 
-Drop::Drop(const glm::vec3& position, Defs::Item type) :
-    m_Type(type), position(position), m_RotationAngle(0.0f), m_Model(1.0f)
+void DropStore::Push(const glm::vec3& position, Defs::Item type)
 {
-    m_Acceleration = { 0.0f, -1.0f, 0.0f };
-    m_Velocity = { 0.0f, 0.0f, 0.0f };
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_X.push_back(position.x);
+    m_Y.push_back(position.y);
+    m_Z.push_back(position.z);
+    m_VelocityY.push_back(0.0f);
+    m_Rotations.push_back(0.0f);
+    m_Types.push_back(type);
 }
 
-Drop::Drop(Drop&& right) noexcept
+void DropStore::Update(World& world, f32 elapsed_time)
 {
-    operator=(std::move(right));
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const u32 count = Count();
+    for (u32 i = 0; i < count; i++)
+    {
+        m_VelocityY[i] -= elapsed_time * 0.5f;
+        m_Y[i] += m_VelocityY[i];
+        m_Rotations[i] += elapsed_time * 2.0f;
+    }
+
+    //The ground is found with a single batched voxel query, which also lands drops on the adjacent chunks
+    m_GroundPositions.resize(count);
+    m_GroundTypes.resize(count);
+    for (u32 i = 0; i < count; i++)
+        m_GroundPositions[i] = glm::ivec3(std::roundf(m_X[i]), static_cast<s32>(m_Y[i]), std::roundf(m_Z[i]));
+    world.GetBlocks(m_GroundPositions.data(), count, m_GroundTypes.data());
+
+    //Backwards, so that the drops moved by Remove were already visited
+    for (u32 i = count; i-- > 0;)
+    {
+        if (m_GroundTypes[i].has_value()) {
+            m_Y[i] = m_GroundPositions[i].y + 0.8f;
+            m_VelocityY[i] = 0.0f;
+            continue;
+        }
+
+        //Falling drops whose chunk was serialized, or below the world, are lost
+        glm::ivec2 chunk_coords;
+        World::ToChunkSpace(m_GroundPositions[i], chunk_coords);
+        if (m_Y[i] < 0.0f || !world.ChunkAt(chunk_coords))
+            Remove(i);
+    }
+
+    RebuildGrid();
 }
 
-Drop& Drop::operator=(Drop&& right) noexcept
+void DropStore::Pickup(const glm::vec3& feet_position, Inventory& inventory)
 {
-    position = right.position;
-    m_Velocity = right.m_Velocity;
-    m_Acceleration = right.m_Acceleration;
-    m_Type = right.m_Type;
-    m_RotationAngle = right.m_RotationAngle;
-    m_Model = right.m_Model;
-    return *this;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const glm::ivec3 feet_cell = glm::ivec3(glm::floor(feet_position / s_PickupDistance));
+    Utils::Vector<u32> picked;
+    for (s32 x = -1; x <= 1; x++)
+    {
+        for (s32 y = -1; y <= 1; y++)
+        {
+            for (s32 z = -1; z <= 1; z++)
+            {
+                auto iter = m_CellHeads.find(CellKey(feet_cell + glm::ivec3(x, y, z)));
+                if (iter == m_CellHeads.end())
+                    continue;
+
+                for (u32 i = iter->second; i != s_NoDrop; i = m_NextInCell[i])
+                    if (glm::length(glm::vec3(m_X[i], m_Y[i], m_Z[i]) - feet_position) < s_PickupDistance)
+                        picked.push_back(i);
+            }
+        }
+    }
+
+    if (picked.empty())
+        return;
+
+    //Removed from the highest index, the drops moved in their place were already handled
+    std::sort(picked.begin(), picked.end(), std::greater<u32>());
+    for (u32 i : picked) {
+        inventory.AddToNewSlot(m_Types[i]);
+        Remove(i);
+    }
+    //Chains now refer to moved indices
+    RebuildGrid();
 }
 
-void Drop::Render()
+u32 DropStore::Render(const Culling::Frustum& frustum, const glm::vec3& camera_position, GlCore::StreamBuffer& stream_buffer)
 {
-    auto drop_shader = GlCore::pstate->drop_shader;
-    auto drop_vm = GlCore::pstate->drop_vm;
-    drop_shader->Use();
-    drop_vm->BindVertexArray();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    const u32 count = Count();
+    if (count == 0)
+        return 0;
+
+    //Half diagonal of the scaled cube
+    constexpr f32 radius = s_Scale * 0.87f;
+    const f32 max_distance = Defs::g_ChunkRenderingDistance;
+    DropInstance* instances = static_cast<DropInstance*>(stream_buffer.Reserve(std::min(count, s_MaxDrawnDrops) * sizeof(DropInstance)));
+    u32 drawn = 0;
+    for (u32 i = 0; i < count && drawn < s_MaxDrawnDrops; i++)
+    {
+        const glm::vec3 position(m_X[i], m_Y[i], m_Z[i]);
+        const glm::vec2 offset(position.x - camera_position.x, position.z - camera_position.z);
+        if (glm::dot(offset, offset) < max_distance * max_distance && Culling::IsSphereVisible(frustum, position, radius))
+            instances[drawn++] = { position, m_Rotations[i], static_cast<f32>(m_Types[i]) };
+    }
+    const u32 offset = stream_buffer.Commit();
+    if (drawn == 0)
+        return 0;
 
-    drop_shader->UniformMat4f(m_Model, "model");
-    drop_shader->Uniform1i(static_cast<u32>(m_Type), "drop_texture_index");
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    Shader* drop_shader = GlCore::pstate->drop_shader;
+    const VertexManager* drop_vm = GlCore::pstate->drop_vm;
+    GlCore::StateCache& cache = *GlCore::pstate->state_cache;
+    cache.UseProgram(drop_shader);
+    cache.Uniform1i(drop_shader, 1, GlCore::CachedUniform::Instanced);
+    cache.BindVertexArray(*drop_vm);
+    glBindBuffer(GL_ARRAY_BUFFER, stream_buffer.Handle());
+    glVertexAttribPointer(GlCore::g_DropTransformLocation, 4, GL_FLOAT, GL_FALSE, sizeof(DropInstance),
+        reinterpret_cast<const void*>(static_cast<uintptr_t>(offset)));
+    glVertexAttribPointer(GlCore::g_DropTypeLocation, 1, GL_FLOAT, GL_FALSE, sizeof(DropInstance),
+        reinterpret_cast<const void*>(static_cast<uintptr_t>(offset + offsetof(DropInstance, type))));
+    glDrawArraysInstanced(GL_TRIANGLES, 0, drop_vm->GetIndicesCount(), drawn);
+    return drawn;
 }
 
-void Drop::Update(Chunk* chunk, f32 elapsed_time)
+u32 DropStore::Size() const
 {
-    m_Velocity += m_Acceleration * elapsed_time * 0.5f;
-    position += m_Velocity;
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return Count();
+}
 
-    glm::vec3 to_find = glm::vec3(std::roundf(position.x), static_cast<s32>(position.y), std::roundf(position.z));
+u32 DropStore::Count() const
+{
+    return static_cast<u32>(m_X.size());
+}
 
-    const auto& vec = chunk->chunk_blocks;
-    auto iter = std::find_if(vec.begin(), vec.end(), [chunk, to_find](const Block& b) {return chunk->ToWorld(b.position) == to_find; });
-    if (iter != vec.end()) {
-        position = { position.x, iter->position.y + 0.8f, position.z};
-        m_Velocity = glm::vec3(0.0f);
-    }
+void DropStore::Remove(u32 index)
+{
+    const u32 last = Count() - 1;
+    m_X[index] = m_X[last];
+    m_Y[index] = m_Y[last];
+    m_Z[index] = m_Z[last];
+    m_VelocityY[index] = m_VelocityY[last];
+    m_Rotations[index] = m_Rotations[last];
+    m_Types[index] = m_Types[last];
+
+    m_X.pop_back();
+    m_Y.pop_back();
+    m_Z.pop_back();
+    m_VelocityY.pop_back();
+    m_Rotations.pop_back();
+    m_Types.pop_back();
 }
 
-void Drop::UpdateModel(f32 elapsed_time)
+u64 DropStore::CellKey(const glm::ivec3& cell)
 {
-    m_Model = glm::translate(glm::mat4(1.0f), position);
-    m_Model = glm::rotate(m_Model, m_RotationAngle, glm::vec3(0.0f, 1.0f, 0.0f));
-    m_Model = glm::scale(m_Model, glm::vec3(0.4f));
+    //21 bits for each coordinate
+    constexpr u64 mask = (1ull << 21) - 1;
+    return (static_cast<u64>(cell.x) & mask) | ((static_cast<u64>(cell.y) & mask) << 21) | ((static_cast<u64>(cell.z) & mask) << 42);
+}
 
-    m_RotationAngle += elapsed_time * 2.0f;
+void DropStore::RebuildGrid()
+{
+    m_CellHeads.clear();
+    m_NextInCell.resize(Count());
+    for (u32 i = 0; i < Count(); i++)
+    {
+        const glm::ivec3 cell = glm::ivec3(glm::floor(glm::vec3(m_X[i], m_Y[i], m_Z[i]) / s_PickupDistance));
+        auto [iter, inserted] = m_CellHeads.try_emplace(CellKey(cell), i);
+        m_NextInCell[i] = inserted ? s_NoDrop : iter->second;
+        iter->second = i;
+    }
 }
@@ -2,28 +2,30 @@
 #include <iostream>
 #include <mutex>
 #include "GlStructure.h"
+#include "Culling.h"
 
 namespace Utils {
     class Serializer;
 }
 
 class Chunk;
+class World;
+class Inventory;
 
 class Block
 {
 public:
     Block(glm::u8vec3 position, const Defs::Item& bt);
-    void UpdateRenderableSides(const Chunk* parent, const glm::vec3& camera_pos);
 
     const Defs::Item& Type() const;
 
-    const GlCore::DrawableData& DrawableSides() const;
     void AddNormal(const glm::vec3& norm);
     void AddNormal(f32 x, f32 y, f32 z);
     void RemoveNormal(const glm::vec3& norm);
     void RemoveNormal(f32 x, f32 y, f32 z);
+    //Sets or clears the normal by its index, avoiding the vector comparisons
+    void SetNormal(u32 index, bool exposed);
     bool HasNormals() const;
-    bool IsDrawable() const;
 
     //Serialization
     void Serialize(const Utils::Serializer& sz);
@@ -38,35 +40,57 @@ public:
     //the array is one
     u8 exposed_normals;
 private:
-    //Drawable sides of a cube(max 3 in 3d space obv)
-    //Determines which sides can be drawn
-    GlCore::DrawableData m_DrawableSides;
     Defs::Item m_Sprite;
 };
 
 constexpr int i = sizeof(Block);
 
-//Version of a block that can be picked up from a player, like in the original Minecraft game
-class Drop 
+//Versions of blocks that can be picked up from a player, like in the original Minecraft game.
+//All the drops of the world are stored SoA, they are simulated in tight loops and drawn with a single instanced draw.
+//The logic thread simulates them while the render thread draws them, hence the mutex
+class DropStore
 {
 public:
-    Drop(const glm::vec3& position, Defs::Item type);
-    Drop(const Drop&) = delete;
-    Drop(Drop&& right) noexcept;
+    static constexpr f32 s_Scale = 0.4f;
+    static constexpr f32 s_PickupDistance = 1.0f;
+    static constexpr u32 s_MaxDrawnDrops = 4096;
 
-    Drop& operator=(Drop&& right) noexcept;
-
-    inline Defs::Item Type() const { return m_Type; }
-
-    void Render();
-    void Update(Chunk* chunk, f32 elapsed_time);
-    void UpdateModel(f32 elapsed_time);
-    glm::vec3 position;
+    void Push(const glm::vec3& position, Defs::Item type);
+    //Drops fall until they land on a block, the ones left without a loaded chunk are removed
+    void Update(World& world, f32 elapsed_time);
+    //Moves in the inventory the drops within reach of the player feet
+    void Pickup(const glm::vec3& feet_position, Inventory& inventory);
+    //Draws the drops in the frustum and the rendering distance, returns how many were drawn
+    u32 Render(const Culling::Frustum& frustum, const glm::vec3& camera_position, GlCore::StreamBuffer& stream_buffer);
+    //Takes the lock, can be called from the render thread while the logic thread updates the drops
+    u32 Size() const;
 private:
-    glm::vec3 m_Velocity;
-    glm::vec3 m_Acceleration;
+    //Same layout of the drop instance attributes of basic_collectable.shader
+    struct DropInstance
+    {
+        glm::vec3 position;
+        f32 rotation;
+        f32 type;
+    };
+
+    //Same of Size, for the callers already holding m_Mutex
+    u32 Count() const;
+    //Keeps the arrays packed by moving the last drop in the removed slot
+    void Remove(u32 index);
+    //Pickup grid cell of a position, cells are as large as the pickup distance
+    static u64 CellKey(const glm::ivec3& cell);
+    void RebuildGrid();
 
-    Defs::Item m_Type;
-    f32 m_RotationAngle;
-    glm::mat4 m_Model;
+    Utils::Vector<f32> m_X, m_Y, m_Z;
+    Utils::Vector<f32> m_VelocityY;
+    Utils::Vector<f32> m_Rotations;
+    Utils::Vector<Defs::Item> m_Types;
+    //First drop of each occupied cell, the next ones are chained through m_NextInCell
+    static constexpr u32 s_NoDrop = static_cast<u32>(-1);
+    Utils::UnorderedMap<u64, u32> m_CellHeads;
+    Utils::Vector<u32> m_NextInCell;
+    //Scratch of the batched ground queries
+    Utils::Vector<glm::ivec3> m_GroundPositions;
+    Utils::Vector<std::optional<Defs::Item>> m_GroundTypes;
+    mutable std::mutex m_Mutex;
 };
@@ -0,0 +1,125 @@
+#include "ChangeTracking.h"
+
+namespace Changes
+{
+	Tracker::Tracker() :
+		m_Kinds(0)
+	{
+		for (auto& sections : m_Sections)
+			sections = 0;
+	}
+
+	Tracker& Tracker::operator=(const Tracker& rhs)
+	{
+		m_Kinds = rhs.m_Kinds.load();
+		for (u32 i = 0; i < g_KindCount; i++)
+			m_Sections[i] = rhs.m_Sections[i].load();
+		return *this;
+	}
+
+	u8 Tracker::Mark(u8 kinds, u32 section)
+	{
+		//Sections first, so that a consumer which sees the kind also sees where it was raised
+		for (u32 i = 0; i < g_KindCount; i++)
+			if (kinds & (1 << i))
+				m_Sections[i].fetch_or(static_cast<u16>(1u << section));
+
+		return kinds & ~m_Kinds.fetch_or(kinds);
+	}
+
+	u8 Tracker::MarkAll(u8 kinds)
+	{
+		for (u32 i = 0; i < g_KindCount; i++)
+			if (kinds & (1 << i))
+				m_Sections[i] = 0xFFFF;
+
+		return kinds & ~m_Kinds.fetch_or(kinds);
+	}
+
+	bool Tracker::Consume(Kind kind)
+	{
+		//The kind is cleared first, a mark racing with this call raises it again and publishes a new event
+		const bool raised = m_Kinds.fetch_and(static_cast<u8>(~kind)) & kind;
+		m_Sections[KindIndex(kind)] = 0;
+		return raised;
+	}
+
+	u16 Tracker::ConsumeSections(Kind kind)
+	{
+		m_Kinds.fetch_and(static_cast<u8>(~kind));
+		return m_Sections[KindIndex(kind)].exchange(0);
+	}
+
+	bool Tracker::Has(Kind kind) const
+	{
+		return m_Kinds & kind;
+	}
+
+	u8 Tracker::Kinds() const
+	{
+		return m_Kinds;
+	}
+
+	u32 Tracker::KindIndex(Kind kind)
+	{
+		u32 index = 0;
+		while (!(kind & (1 << index)))
+			index++;
+		return index;
+	}
+
+	EventQueue::EventQueue(u32 capacity) :
+		m_Cells(std::make_unique<Cell[]>(capacity)), m_Mask(capacity - 1)
+	{
+		MC_ASSERT(capacity > 0 && (capacity & m_Mask) == 0, "The capacity must be a power of two");
+		for (u32 i = 0; i < capacity; i++)
+			m_Cells[i].sequence = i;
+	}
+
+	void EventQueue::Push(const Event& event)
+	{
+		//Each cell's sequence tells whose turn it is: equal to the position when it can be written,
+		//position + 1 once the event is readable
+		u32 position = m_Tail.load(std::memory_order_relaxed);
+		Cell* cell = nullptr;
+		while (true)
+		{
+			cell = &m_Cells[position & m_Mask];
+			const u32 sequence = cell->sequence.load(std::memory_order_acquire);
+			const s32 difference = static_cast<s32>(sequence - position);
+			if (difference == 0) {
+				if (m_Tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (difference < 0) {
+				m_Overflow.store(true, std::memory_order_release);
+				return;
+			}
+			else {
+				position = m_Tail.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->event = event;
+		cell->sequence.store(position + 1, std::memory_order_release);
+	}
+
+	bool EventQueue::Pop(Event& event)
+	{
+		Cell& cell = m_Cells[m_Head & m_Mask];
+		const u32 sequence = cell.sequence.load(std::memory_order_acquire);
+		if (static_cast<s32>(sequence - (m_Head + 1)) < 0)
+			return false;
+
+		event = cell.event;
+		//The cell can be written again on the next lap
+		cell.sequence.store(m_Head + m_Mask + 1, std::memory_order_release);
+		m_Head++;
+		return true;
+	}
+
+	bool EventQueue::ConsumeOverflow()
+	{
+		return m_Overflow.exchange(false, std::memory_order_acquire);
+	}
+}
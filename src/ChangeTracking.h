@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <memory>
+#include "glm/glm.hpp"
+
+#include "Utils.h"
+
+//Tracks what changed in each chunk, so that every cache derived from the blocks
+//invalidates only its own data and only where the change happened
+namespace Changes
+{
+	//Derived data of a chunk, each one cleared by its own consumer
+	enum Kind : u8
+	{
+		//Packed faces in the instance pool
+		RenderBuffer = 1 << 0,
+		//Shadow map tiles over the chunk
+		Shadow = 1 << 1,
+		//Face connectivity of the sections, used by the cave culling
+		Connectivity = 1 << 2,
+		//Difference from the saved sector file
+		Serialization = 1 << 3,
+	};
+	static constexpr u32 g_KindCount = 4;
+	static constexpr u8 g_AllKinds = RenderBuffer | Shadow | Connectivity | Serialization;
+	//The exposed faces of a block changed
+	static constexpr u8 g_FaceChange = RenderBuffer | Shadow | Serialization;
+	//A position was filled or emptied
+	static constexpr u8 g_BlockChange = g_AllKinds;
+	//Kinds consumed by the render thread when the chunk is rebuilt
+	static constexpr u8 g_RenderKinds = RenderBuffer | Shadow | Connectivity;
+
+	//Dirty bits of a single chunk, for the whole chunk and for each of its 16 sections.
+	//Can be raised from any thread
+	class Tracker
+	{
+	public:
+		Tracker();
+		Tracker& operator=(const Tracker& rhs);
+
+		//Both return the kinds which were not raised yet
+		u8 Mark(u8 kinds, u32 section);
+		u8 MarkAll(u8 kinds);
+		//Clears the kind, returns true if it was raised
+		bool Consume(Kind kind);
+		//Clears the kind and returns the sections where it was raised
+		u16 ConsumeSections(Kind kind);
+		bool Has(Kind kind) const;
+		u8 Kinds() const;
+
+	private:
+		static u32 KindIndex(Kind kind);
+
+		std::atomic<u8> m_Kinds;
+		std::array<std::atomic<u16>, g_KindCount> m_Sections;
+	};
+
+	//Published once per chunk when one of its kinds goes from clean to dirty
+	struct Event
+	{
+		glm::ivec2 chunk_coords;
+		u32 sector_index;
+		u8 kinds;
+	};
+
+	//Bounded lock-free queue, any thread can push and a single consumer pops. When it is full
+	//the event is dropped and the overflow flag is raised, the consumer must then assume that
+	//everything changed
+	class EventQueue
+	{
+	public:
+		explicit EventQueue(u32 capacity);
+		EventQueue(const EventQueue&) = delete;
+		EventQueue& operator=(const EventQueue&) = delete;
+
+		void Push(const Event& event);
+		bool Pop(Event& event);
+		//Returns true once after the queue overflowed
+		bool ConsumeOverflow();
+
+	private:
+		struct Cell
+		{
+			std::atomic<u32> sequence;
+			Event event;
+		};
+
+		std::unique_ptr<Cell[]> m_Cells;
+		const u32 m_Mask;
+		std::atomic<u32> m_Tail = 0;
+		u32 m_Head = 0;
+		std::atomic<bool> m_Overflow = false;
+	};
+}
@@ -3,11 +3,21 @@
 #include "InventorySystem.h"
 #include "Renderer.h"
 #include <algorithm>
+#include <bitset>
 #include <chrono>
 
 //Half a chunk's diagonal
 f32 Chunk::s_DiagonalLenght = 0.0f;
-u32 Chunk::s_InternalSelectedBlock = static_cast<u32>(-1);
+
+//Offsets of the adjacent positions, in the same order as the block normals
+const std::array<glm::ivec3, 6> neighbor_offsets = {
+	glm::ivec3( 1,  0,  0),
+	glm::ivec3(-1,  0,  0),
+	glm::ivec3( 0,  1,  0),
+	glm::ivec3( 0, -1,  0),
+	glm::ivec3( 0,  0,  1),
+	glm::ivec3( 0,  0, -1),
+};
 
 ChunkGeneration ComputeGeneration(Defs::WorldSeed& seed, f32 origin_x, f32 origin_z) 
 {
@@ -36,6 +46,8 @@ Chunk::Chunk(World& father, glm::vec2 origin)
 	m_ChunkOrigin({origin.x, 0.0f, origin.y}), m_SelectedBlock(static_cast<u32>(-1)),
 	m_ChunkCenter(0.0f), m_SectorIndex(0)
 {
+	//Nothing derived from the blocks exists yet
+	m_Changes.MarkAll(Changes::g_AllKinds);
 	//Assigning chunk index
 	m_ChunkIndex = Defs::g_ChunkProgIndex++;
 	m_ChunkCenter = m_ChunkOrigin + GetHalfWayVector();
@@ -87,6 +99,13 @@ Chunk::Chunk(World& father, glm::vec2 origin)
 	}
 
 	lower_threshold = lower_height;
+	m_MaterializedCells.resize((lower_threshold * s_ChunkWidthAndHeight * s_ChunkWidthAndHeight + 63) / 64, 0);
+	InitImplicitBorderRows();
+
+	//Trees and later placements raise the heightmap while being inserted
+	for (u32 i = 0; i < m_Heightmap.size(); i++)
+		m_Heightmap[i] = static_cast<s16>(gen.heights[i]) - 1;
+	m_LowestExposed.fill(static_cast<s16>(s_MaxHeight));
 
 	//Insert the y coordinates consecutively to allow the
 	//normal insertion algorithm later
@@ -104,11 +123,11 @@ Chunk::Chunk(World& father, glm::vec2 origin)
 				switch (biome)
 				{
 				case Defs::Biome::Plains:
-					chunk_blocks.emplace_back(glm::u8vec3(i, j, k), (j == final_height - 1) ?
+					InsertBlock(glm::ivec3(i, j, k), (j == final_height - 1) ?
 						Defs::Item::Grass : Defs::Item::Dirt);
 					break;
 				case Defs::Biome::Desert:
-					chunk_blocks.emplace_back(glm::u8vec3(i, j, k), Defs::Item::Sand);
+					InsertBlock(glm::ivec3(i, j, k), Defs::Item::Sand);
 					break;
 				}
 			}
@@ -127,13 +146,14 @@ Chunk::Chunk(World& father, glm::vec2 origin)
 			glm::vec3 tree_center(s_ChunkWidthAndHeight / 2, final_height + 4, s_ChunkWidthAndHeight / 2);
 			if (biome == Defs::Biome::Plains && i == tree_center.x && k == tree_center.z) {
 				for (u32 p = 0; p < 4; p++)
-					chunk_blocks.emplace_back(glm::vec3(i, final_height + p, k), Defs::Item::Wood);
+					InsertBlock(glm::ivec3(i, final_height + p, k), Defs::Item::Wood);
 
 				for (auto& vec : leaves_positions)
-					chunk_blocks.emplace_back(static_cast<glm::u8vec3>(tree_center + vec), Defs::Item::Leaves);
+					InsertBlock(glm::ivec3(tree_center + vec), Defs::Item::Leaves);
 			}
 		}
 	}
+	BuildWaterRects();
 	//Set chunk sector
 	m_SectorIndex = Defs::ChunkSectorIndex({m_ChunkOrigin.x, m_ChunkOrigin.z});
 	Defs::g_PushedSections.insert(m_SectorIndex);
@@ -144,7 +164,11 @@ Chunk::Chunk(World& father, const Utils::Serializer& sz, u32 index) :
 	m_SectorIndex(index), m_SelectedBlock(static_cast<u32>(-1))
 {
 	//Simply forward everithing to the deserializing operator
+	m_Changes.MarkAll(Changes::g_AllKinds);
 	Deserialize(sz);
+	BuildWaterRects();
+	//The chunk matches its sector file until it is edited
+	m_Changes.Consume(Changes::Serialization);
 }
 
 Chunk::Chunk(Chunk&& rhs) noexcept :
@@ -162,6 +186,21 @@ Chunk& Chunk::operator=(Chunk&& rhs) noexcept
 	m_ChunkIndex = rhs.m_ChunkIndex;
 
 	chunk_blocks = std::move(rhs.chunk_blocks);
+	lower_threshold = rhs.lower_threshold;
+	m_MaterializedCells = std::move(rhs.m_MaterializedCells);
+	m_Sections = std::move(rhs.m_Sections);
+	m_BorderPlanes = rhs.m_BorderPlanes;
+	m_Heightmap = rhs.m_Heightmap;
+	m_LowestExposed = rhs.m_LowestExposed;
+	m_Changes = rhs.m_Changes;
+	m_PublishChanges = rhs.m_PublishChanges;
+	m_WaterRects = std::move(rhs.m_WaterRects);
+	m_WaterChanged = rhs.m_WaterChanged;
+	m_FaceBuckets = rhs.m_FaceBuckets;
+	m_FaceHeightRange = rhs.m_FaceHeightRange;
+	m_RenderHeightRange = rhs.m_RenderHeightRange;
+	m_SectionConnectivity = rhs.m_SectionConnectivity;
+	m_SolidHeight = rhs.m_SolidHeight;
 	m_ChunkOrigin = rhs.m_ChunkOrigin;
 	m_ChunkCenter = rhs.m_ChunkCenter;
 	m_SectorIndex = rhs.m_SectorIndex;
@@ -181,276 +220,65 @@ void Chunk::InitGlobalNorms()
 	m_PlusZ = m_RelativeWorld.IsChunk(*this, Defs::ChunkLocation::PlusZ);
 	m_MinusZ = m_RelativeWorld.IsChunk(*this, Defs::ChunkLocation::MinusZ);
 
-	//Getting the relative ptr(can be nullptr obv)
-	Pointer<Chunk> chunk_plus_x = m_PlusX.has_value() ? m_RelativeWorld.GetChunk(m_PlusX.value()) : nullptr;
-	Pointer<Chunk> chunk_minus_x = m_MinusX.has_value() ? m_RelativeWorld.GetChunk(m_MinusX.value()) : nullptr;
-	Pointer<Chunk> chunk_plus_z = m_PlusZ.has_value() ? m_RelativeWorld.GetChunk(m_PlusZ.value()) : nullptr;
-	Pointer<Chunk> chunk_minus_z = m_MinusZ.has_value() ? m_RelativeWorld.GetChunk(m_MinusZ.value()) : nullptr;
-
-	//Get normals
-	const glm::vec3 pos_x(1.0f, 0.0f, 0.0f);
-	const glm::vec3 neg_x(-1.0f, 0.0f, 0.0f);
-	const glm::vec3 pos_y(0.0f, 1.0f, 0.0f);
-	const glm::vec3 neg_y(0.0f, -1.0f, 0.0f);
-	const glm::vec3 pos_z(0.0f, 0.0f, 1.0f);
-	const glm::vec3 neg_z(0.0f, 0.0f, -1.0f);
-
-	//The following algorithm determines with precise accuracy and pretty fast speed which faces of each
-	//block of the this chunk can be seen
-	//The algorithm analyses each column of blocks in the 16x16 which can be found in the chunk and
-	//from the top block of that column an index descends assigning to each side a normal
-	//until a side block is found
-	f32 local_x = m_ChunkOrigin.x + chunk_blocks[0].position.x, local_z = m_ChunkOrigin.z + chunk_blocks[0].position.z;
-	s32 starting_index = 0;
-	//+1 because we need to parse the last column
-	for (s32 i = 0; i < chunk_blocks.size(); i++)
+	//Faces between blocks of this chunk, the ones facing other chunks are handled below
+	const s32 side = static_cast<s32>(s_ChunkWidthAndHeight);
+	for (Block& block : chunk_blocks)
 	{
-		glm::vec3 loc_pos = ToWorld(chunk_blocks[i].position);
-
-		//Always include the last block
-		if (i != chunk_blocks.size() - 1 &&
-			loc_pos.x == local_x &&
-			loc_pos.z == local_z)
+		for (u32 i = 0; i < neighbor_offsets.size(); i++)
 		{
-			continue;
-		}
-
-		local_x = loc_pos.x;
-		local_z = loc_pos.z;		
-
-		u32 top_column_index = (i == chunk_blocks.size() - 1) ? i : i - 1;
-		//The block at the top of the pile and the one at the bottom
-		auto& top_block = chunk_blocks[top_column_index];
-		auto& bot_block = chunk_blocks[starting_index];
-
-		const glm::vec3 block_pos = ToWorld(top_block.position);
-
-		//if the blocks confines with another chunk right left front or back
-		bool conf_rlfb[4];
-		conf_rlfb[0] = block_pos.x == m_ChunkOrigin.x + s_ChunkWidthAndHeight - 1;
-		conf_rlfb[1] = block_pos.x == m_ChunkOrigin.x;
-		conf_rlfb[2] = block_pos.z == m_ChunkOrigin.z;
-		conf_rlfb[3] = block_pos.z == m_ChunkOrigin.z + s_ChunkWidthAndHeight - 1;
-
-		//Upper block of a column is always visible from the top
-		top_block.AddNormal(pos_y);
-
-		s32 p = top_column_index;
-		if (conf_rlfb[0] || conf_rlfb[1] || conf_rlfb[2] || conf_rlfb[3])
-		{
-			u32 blk_index;
-			bool local_found = false, adjacent_found = false;
-			//Checking also for neighbor chunks
-			//Right
-			while (p >= starting_index)
-			{
-				//If the block confines with a chunk that does not exist yet, we wont
-				//push any normals, they will be deleted anyway when a new chunk spawns
-				if (conf_rlfb[0] && !chunk_plus_x.Valid())
-					break;
-				
-				//If we find the ground in a side check, break from the loop
-				if (BorderCheck(chunk_plus_x.Raw(), pos_x, p, starting_index, true))
-					break;
-
-				p--;
-			}
-			p = top_column_index;
-			//Left
-			while (p >= starting_index)
-			{
-				if (conf_rlfb[1] && !chunk_minus_x.Valid())
-					break;
-
-				if (BorderCheck(chunk_minus_x.Raw(), neg_x, p, starting_index, false))
-					break;
-
-				p--;
-			}
-			p = top_column_index;
-			//Back
-			while (p >= starting_index)
-			{
-				if (conf_rlfb[3] && !chunk_plus_z.Valid())
-					break;
-
-				if (BorderCheck(chunk_plus_z.Raw(), pos_z, p, starting_index, true))
-					break;
-
-				p--;
-			}
-			p = top_column_index;
-			//Front
-			while (p >= starting_index)
-			{
-				if (conf_rlfb[2] && !chunk_minus_z.Valid())
-					break;
-
-				if (BorderCheck(chunk_minus_z.Raw(), neg_z, p, starting_index, false))
-					break;
-
-				p--;
-			}
-		}
-		else
-		{
-			//A more slim implementation for the majority of the iterations
-			//Right
-			u32 blk_index;
-			while (p >= starting_index)
-			{
-				auto pos = ToWorld(chunk_blocks[p].position) + pos_x;
-				if (!IsBlock(pos, starting_index, true, &blk_index)) {
-					chunk_blocks[p].AddNormal(pos_x);
-				}
-				else {
-					//If the current block is a leaf block, we wont discard lower placed blocks automatically
-					//because we could find trunk or some other stuff
-					if (chunk_blocks[blk_index].Type() != Defs::Item::Leaves)
-						break;
-				}
-
-				p--;
-			}
-			p = top_column_index;
-			//Left
-			while (p >= starting_index)
-			{
-				auto pos = ToWorld(chunk_blocks[p].position) + neg_x;
-				if (!IsBlock(pos, starting_index, false, &blk_index)) {
-					chunk_blocks[p].AddNormal(neg_x);
-				}
-				else {
-					if (chunk_blocks[blk_index].Type() != Defs::Item::Leaves)
-						break;
-				}
-				p--;
-			}
-			p = top_column_index;
-			//Back
-			while (p >= starting_index)
-			{
-				auto pos = ToWorld(chunk_blocks[p].position) + pos_z;
-				if (!IsBlock(pos, starting_index, true, &blk_index)) {
-					chunk_blocks[p].AddNormal(pos_z);
-				}
-				else {
-					if (chunk_blocks[blk_index].Type() != Defs::Item::Leaves)
-						break;
-				}
-				
-				p--;
-			}
-			p = top_column_index;
-			//Front
-			while (p >= starting_index)
-			{
-				auto pos = ToWorld(chunk_blocks[p].position) + neg_z;
-				if (!IsBlock(pos, starting_index, false, &blk_index)) {
-					chunk_blocks[p].AddNormal(neg_z);
-				}
-				else {
-					if (chunk_blocks[blk_index].Type() != Defs::Item::Leaves)
-						break;
-				}
+			glm::ivec3 pos = glm::ivec3(block.position) + neighbor_offsets[i];
+			if (pos.x < 0 || pos.x >= side || pos.z < 0 || pos.z >= side)
+				continue;
 
-				p--;
-			}
+			SetBlockFace(block, i, !IsSolid(pos));
 		}
-		//Push a normal at the bottom
-		if(bot_block.position.y != lower_threshold)
-			bot_block.AddNormal(neg_y);
-
+	}
 
-		//Adding additional normals to side chunks, which were not considered because there hasn't
-		//been a spawned chunk yet
-		if (conf_rlfb[0] && chunk_plus_x.Valid())
-		{
-			u32 block_index;
-			//Emplacing back normals from the first block higher than the current one 
-			glm::vec3 begin_check = pos_y;
-			while (chunk_plus_x->IsBlock(ToWorld(top_block.position) + pos_x + begin_check, 0, true, &block_index))
-			{
-				chunk_plus_x->GetBlock(block_index).AddNormal(-1.0f, 0.0f, 0.0f);
-				begin_check.y += 1.0f;
-			}
-		}
+	//If the block confines with a chunk that does not exist yet, we wont
+	//push any normals, they will be added when the chunk spawns
+	const Defs::ChunkLocation locations[] = { Defs::ChunkLocation::PlusX, Defs::ChunkLocation::MinusX,
+		Defs::ChunkLocation::PlusZ, Defs::ChunkLocation::MinusZ };
+	const glm::ivec2 offsets[] = { glm::ivec2(1, 0), glm::ivec2(-1, 0), glm::ivec2(0, 1), glm::ivec2(0, -1) };
+	for (u32 i = 0; i < 4; i++)
+	{
+		if (Chunk* side_chunk = m_RelativeWorld.ChunkAt(ChunkCoords() + offsets[i]))
+			ExchangeBorderFaces(*side_chunk, locations[i]);
+	}
+}
 
-		if (conf_rlfb[1] && chunk_minus_x.Valid())
-		{
-			u32 block_index;
-			glm::vec3 begin_check = pos_y;
-			while (chunk_minus_x->IsBlock(ToWorld(top_block.position) + neg_x + begin_check, 0, true, &block_index))
-			{
-				chunk_minus_x->GetBlock(block_index).AddNormal(1.0f, 0.0f, 0.0f);
-				begin_check.y += 1.0f;
-			}
-		}
+void Chunk::UpdateFacesAround(const glm::ivec3& local_pos)
+{
+	const bool solid = IsSolid(local_pos);
+	if (u32 index = BlockIndexAt(local_pos); index != s_NoBlock)
+		ComputeBlockFaces(chunk_blocks[index]);
 
-		if (conf_rlfb[2] && chunk_minus_z.Valid())
-		{
-			u32 block_index;
-			glm::vec3 local_pos = pos_y;
-			while (chunk_minus_z->IsBlock(ToWorld(top_block.position) + neg_z + local_pos, 0, true, &block_index))
-			{
-				chunk_minus_z->GetBlock(block_index).AddNormal(0.0f, 0.0f, 1.0f);
-				local_pos.y += 1.0f;
-			}
-		}
+	//Only the side facing local_pos can change for each neighbor
+	for (u32 i = 0; i < neighbor_offsets.size(); i++)
+	{
+		glm::ivec3 pos = local_pos + neighbor_offsets[i];
+		Chunk* chunk = ResolveNeighbor(pos);
+		if (!chunk)
+			continue;
 
-		if (conf_rlfb[3] && chunk_plus_z.Valid())
-		{
-			u32 block_index;
-			glm::vec3 local_pos = pos_y;
-			while (chunk_plus_z->IsBlock(ToWorld(top_block.position) + pos_z + local_pos, 0, true, &block_index))
-			{
-				chunk_plus_z->GetBlock(block_index).AddNormal(0.0f, 0.0f, -1.0f);
-				local_pos.y += 1.0f;
-			}
-		}
+		u32 index = chunk->BlockIndexAt(pos);
+		if (index == s_NoBlock)
+			continue;
 
-		starting_index = i;
+		//Normal indices come in (positive, negative) pairs, so i ^ 1 is the opposite side
+		chunk->SetBlockFace(chunk->chunk_blocks[index], i ^ 1, !solid);
 	}
 }
 
-void Chunk::AddFreshNormals(Block& b)
+void Chunk::ComputeBlockFaces(Block& block)
 {
-	const glm::vec3 block_pos = ToWorld(b.position);
-
-	bool conf_rlfb[4];
-	conf_rlfb[0] = block_pos.x == m_ChunkOrigin.x + s_ChunkWidthAndHeight - 1;
-	conf_rlfb[1] = block_pos.x == m_ChunkOrigin.x;
-	conf_rlfb[2] = block_pos.z == m_ChunkOrigin.z;
-	conf_rlfb[3] = block_pos.z == m_ChunkOrigin.z + s_ChunkWidthAndHeight - 1;
-
-	auto local_lambda = [&](bool side_check, Defs::ChunkLocation cl, const glm::vec3& dir)
+	for (u32 i = 0; i < neighbor_offsets.size(); i++)
 	{
-		bool add_norm = true;
-		if (side_check)
-		{
-			if (auto opt = m_RelativeWorld.IsChunk(*this, cl); opt.has_value())
-			{
-				Pointer<Chunk> chunk = m_RelativeWorld.GetChunk(opt.value());
-				if (chunk->IsBlock(block_pos + dir))
-					add_norm = false;
-			}
-		}
-		else
-		{
-			if (IsBlock(block_pos + dir))
-				add_norm = false;
-		}
-
-		if (add_norm)
-			b.AddNormal(dir);
-	};
-
-	local_lambda(conf_rlfb[0], Defs::ChunkLocation::PlusX, glm::vec3( 1.0f, 0.0f, 0.0f));
-	local_lambda(conf_rlfb[1], Defs::ChunkLocation::MinusX, glm::vec3(-1.0f, 0.0f, 0.0f));
-	local_lambda(false, Defs::ChunkLocation::None, glm::vec3( 0.0f, 1.0f, 0.0f));
-	local_lambda(false, Defs::ChunkLocation::None, glm::vec3(0.0f, -1.0f, 0.0f));
-	local_lambda(conf_rlfb[2], Defs::ChunkLocation::PlusZ, glm::vec3( 0.0f, 0.0f, 1.0f));
-	local_lambda(conf_rlfb[3], Defs::ChunkLocation::MinusZ, glm::vec3(0.0f, 0.0f, -1.0f));
+		glm::ivec3 pos = glm::ivec3(block.position) + neighbor_offsets[i];
+		//If the block confines with a chunk that does not exist yet, we wont
+		//push any normals, they will be added when the chunk spawns
+		Chunk* chunk = ResolveNeighbor(pos);
+		SetBlockFace(block, i, chunk && !chunk->IsSolid(pos));
+	}
 }
 
 std::pair<f32, Defs::HitDirection> Chunk::RayCollisionLogic(const glm::vec3& camera_position, const glm::vec3& camera_direction)
@@ -468,7 +296,7 @@ std::pair<f32, Defs::HitDirection> Chunk::RayCollisionLogic(const glm::vec3& cam
 		//Player view ray block collision
 		auto& block = chunk_blocks[i];
 		//Discard automatically blocks which cant be selected or seen
-		if (!block.IsDrawable())
+		if (!block.HasNormals())
 			continue;
 
 		f32 dist = 0.0f;
@@ -489,7 +317,7 @@ std::pair<f32, Defs::HitDirection> Chunk::RayCollisionLogic(const glm::vec3& cam
 	return { closest_selected_block_dist, selection };
 }
 
-bool Chunk::BlockCollisionLogic(glm::vec3& position)
+bool Chunk::BlockCollisionLogic(glm::vec3& position, Physics::Collision& collision)
 {
 	f32 clip_threshold = 0.9f;
 	bool result = false;
@@ -508,26 +336,26 @@ bool Chunk::BlockCollisionLogic(glm::vec3& position)
 			if (Defs::g_PlayerSpeed != 0.0f) {
 				if (abs_diff.z > abs_diff.x && abs_diff.z > y_halved) {
 					position.z = position.z < block_pos.z ? block_pos.z - clip_threshold : block_pos.z + clip_threshold;
-					Defs::g_PlayerAxisMapping.z = 0.0f;
+					collision.blocked_axes.z = true;
 					result = true;
 				}
 
 				if (abs_diff.x > y_halved && abs_diff.x > abs_diff.z) {
 					position.x = position.x < block_pos.x ? block_pos.x - clip_threshold : block_pos.x + clip_threshold;
-					Defs::g_PlayerAxisMapping.x = 0.0f;
+					collision.blocked_axes.x = true;
 					result = true;
 				}
 			}
 
 			if (y_halved > abs_diff.z && y_halved > abs_diff.x) {
-				Defs::g_PlayerAxisMapping.y = 0.0f;
+				collision.blocked_axes.y = true;
 				if (position.y < block_pos.y) {
 					position.y = block_pos.y - clip_threshold;
-					Defs::jump_data = { 0.0f, false };
+					collision.grounded = false;
 				}
 				else {
 					position.y = block_pos.y + clip_threshold * 2.0f;
-					Defs::jump_data = { 0.0f, true };
+					collision.grounded = true;
 				}
 			}
 		}
@@ -536,98 +364,62 @@ bool Chunk::BlockCollisionLogic(glm::vec3& position)
 	return result;
 }
 
-void Chunk::UpdateBlocks(Inventory& inventory, f32 elapsed_time)
-{
-	auto& camera_position = m_State.camera->GetPosition();
-
-	//Update each single block
-	for (auto& block : chunk_blocks)
-		block.UpdateRenderableSides(this, camera_position);
-
-	//Update local drops
-	for (auto iter = m_LocalDrops.begin(); iter != m_LocalDrops.end(); ++iter) {
-		auto& drop = *iter;
-		drop.Update(this, elapsed_time);
-		drop.UpdateModel(elapsed_time);
-
-		//Done because the actual player is the head position, we want to grab these when we
-		//step on them
-		glm::vec3 ground_position = m_State.camera->GetPosition();
-		ground_position.y -= 1.0f;
-		if (glm::length(drop.position - ground_position) < 1.0f) {
-			inventory.AddToNewSlot(drop.Type());
-			bool last_flag = iter == std::prev(m_LocalDrops.end());
-			iter = m_LocalDrops.erase(iter);
-
-			//need this otherwise the program will crash for incrementing a dangling iterator
-			if (last_flag)
-				break;
-		}
-	}
-}
-
-bool Chunk::IsChunkRenderable(const glm::vec3& camera_position) const
+bool Chunk::IsChunkRenderable(const glm::vec3& camera_position, f32 margin) const
 {
 	//This algorithm does not take account for the player altitude in space
 	glm::vec2 cam_pos(camera_position.x, camera_position.z);
 	glm::vec2 chunk_center_pos(m_ChunkCenter.x, m_ChunkCenter.z);
-	return (glm::length(cam_pos - chunk_center_pos) < Defs::g_ChunkRenderingDistance);
+	const glm::vec2 offset = cam_pos - chunk_center_pos;
+	const f32 distance = Defs::g_ChunkRenderingDistance + margin;
+	return glm::dot(offset, offset) < distance * distance;
 }
 
-bool Chunk::IsChunkVisible(const glm::vec3& camera_position, const glm::vec3& camera_direction) const
+bool Chunk::RenderBounds(glm::vec3& min, glm::vec3& max) const
 {
-	glm::vec3 camera_to_midway = glm::normalize(m_ChunkCenter - camera_position);
-	return (glm::dot(camera_to_midway, camera_direction) > 0.4f ||
-		glm::length(camera_position - m_ChunkCenter) < s_DiagonalLenght + Defs::g_CameraCompensation);
+	const glm::vec2 height_range = m_RenderHeightRange;
+	if (height_range.x > height_range.y)
+		return false;
+
+	//Block positions are centers, faces lie half a block away
+	min = m_ChunkOrigin + glm::vec3(-0.5f, height_range.x - 0.5f, -0.5f);
+	max = m_ChunkOrigin + glm::vec3(s_ChunkWidthAndHeight - 0.5f, height_range.y + 0.5f, s_ChunkWidthAndHeight - 0.5f);
+	return true;
 }
 
-bool Chunk::IsChunkVisibleByShadow(const glm::vec3& camera_position, const glm::vec3& camera_direction) const
+s32 Chunk::SolidColumnHeight(u32 x, u32 z) const
 {
-	glm::vec3 camera_to_midway = glm::normalize(m_ChunkCenter - camera_position);
-	return (glm::dot(camera_to_midway, camera_direction) > 0.5f);
+	//An empty position below the lowest exposed face would expose the face of the block above it,
+	//so everything up to two blocks below it (and below the heightmap) is solid
+	return std::min(ColumnHeight(x, z), LowestExposed(x, z) - 2);
 }
 
-void Chunk::RemoveBorderNorm(const glm::vec3& norm)
+void Chunk::AppendOccluders(Culling::BoundsBatch& occluders) const
 {
-	//Function that determines if a block normal towards the chunk can be removed,
-	//depending on if there is a block next to him in the desired direction.
-	//If there is no block, the normal isn't going to be removed
-	auto erase_flanked_normal = [&](Block& block, const glm::vec3& vec, const Defs::ChunkLocation& loc)
+	static constexpr u32 tile_size = 4;
+	for (u32 tile_x = 0; tile_x < s_ChunkWidthAndHeight; tile_x += tile_size)
 	{
-		u32 index = GetLoadedChunk(loc).value_or(0);
-		glm::vec3 block_pos = ToWorld(block.position) + vec;
-		bool is_block = m_RelativeWorld.GetChunk(index)->IsBlock(block_pos);
+		for (u32 tile_z = 0; tile_z < s_ChunkWidthAndHeight; tile_z += tile_size)
+		{
+			s32 top = s_MaxHeight;
+			for (u32 x = tile_x; x < tile_x + tile_size; x++)
+				for (u32 z = tile_z; z < tile_z + tile_size; z++)
+					top = std::min(top, SolidColumnHeight(x, z));
 
-		if (is_block)
-			block.RemoveNormal(norm);
-	};
+			if (top < 0)
+				continue;
 
-	//I remind you that the y component in the chunk origin is actually the world z component
-	if (norm == glm::vec3(1.0f, 0.0f, 0.0f))
-	{
-		for (auto& block : chunk_blocks)
-			if (block.position.x == s_ChunkWidthAndHeight - 1)
-				erase_flanked_normal(block, norm, Defs::ChunkLocation::PlusX);
-	}
-	else if (norm == glm::vec3(-1.0f, 0.0f, 0.0f))
-	{
-		for (auto& block : chunk_blocks)
-			if (block.position.x == 0)
-				erase_flanked_normal(block, norm, Defs::ChunkLocation::MinusX);
-	}
-	else if (norm == glm::vec3(0.0f, 0.0f, 1.0f))
-	{
-		for (auto& block : chunk_blocks)
-			if (block.position.z == s_ChunkWidthAndHeight - 1)
-				erase_flanked_normal(block, norm, Defs::ChunkLocation::PlusZ);
-	}
-	else if (norm == glm::vec3(0.0f, 0.0f, -1.0f))
-	{
-		for (auto& block : chunk_blocks)
-			if (block.position.z == 0)
-				erase_flanked_normal(block, norm, Defs::ChunkLocation::MinusZ);
+			//Spanning the block centers keeps the box inside the solid volume
+			const glm::vec3 min = m_ChunkOrigin + glm::vec3(tile_x, 0.0f, tile_z);
+			const glm::vec3 max = m_ChunkOrigin + glm::vec3(tile_x + tile_size - 1, top, tile_z + tile_size - 1);
+			occluders.Push(min, max);
+		}
 	}
+}
 
+bool Chunk::IsChunkVisibleByShadow(const glm::vec3& camera_position, const glm::vec3& camera_direction) const
+{
+	glm::vec3 camera_to_midway = glm::normalize(m_ChunkCenter - camera_position);
+	return (glm::dot(camera_to_midway, camera_direction) > 0.5f);
 }
 
 const std::optional<u32>& Chunk::GetLoadedChunk(const Defs::ChunkLocation& cl) const
@@ -650,6 +442,8 @@ const std::optional<u32>& Chunk::GetLoadedChunk(const Defs::ChunkLocation& cl) c
 
 void Chunk::SetLoadedChunk(const Defs::ChunkLocation& cl, u32 value)
 {
+	//The neighbor indices are serialized
+	MarkAllChanged(Changes::Serialization);
 	switch (cl)
 	{
 	case Defs::ChunkLocation::PlusX:
@@ -667,94 +461,263 @@ void Chunk::SetLoadedChunk(const Defs::ChunkLocation& cl, u32 value)
 	}
 }
 
-void Chunk::ForwardRenderableData(glm::vec3*& position_buf, u32*& texindex_buf, u32& count, bool depth_buf_draw, bool selected) const
+void Chunk::BuildInstances(Utils::Vector<u32>& instances, bool greedy)
 {
-	//We let this algorithm fill the buffers of the instanced shader attributes
-	for (u64 i = 0; i < chunk_blocks.size(); ++i)
+	//Cleared before reading the blocks, so that edits made meanwhile by the logic thread
+	//schedule another rebuild
+	m_Changes.Consume(Changes::RenderBuffer);
+	instances.clear();
+
+	const u16 dirty_sections = m_Changes.ConsumeSections(Changes::Connectivity);
+	for (u32 section = 0; section < s_SectionCount; section++)
+		if (dirty_sections & (1u << section))
+			ComputeSectionConnectivity(section);
+
+	s32 min_y = s_MaxHeight, max_y = -1;
+	for (auto& block : chunk_blocks)
 	{
-		auto& block = chunk_blocks[i];
-		if (!depth_buf_draw)
-		{
-			//For standard drawcalls, we care about visible blocks
-			if (!block.IsDrawable())
-				continue;
+		if (!block.exposed_normals)
+			continue;
 
-			texindex_buf[count] = static_cast<u32>(block.Type());
-			position_buf[count++] = ToWorld(block.position);
+		min_y = std::min<s32>(min_y, block.position.y);
+		max_y = std::max<s32>(max_y, block.position.y);
+	}
+	m_FaceHeightRange = { min_y, max_y };
 
-			//Handle selection by pushing another matrix and a null index
-			if (selected && i == s_InternalSelectedBlock)
-			{
-				texindex_buf[count] = 256 + texindex_buf[count - 1];
-				position_buf[count] = position_buf[count - 1];
-				count++;
-			}
+	//Water layers never change after the chunk spawns, they only extend the bounds
+	glm::vec2 render_range(static_cast<f32>(min_y), static_cast<f32>(max_y));
+	for (auto& layer : m_WaterLayerPositions)
+	{
+		render_range.x = std::min(render_range.x, layer.y);
+		render_range.y = std::max(render_range.y, layer.y);
+	}
+	m_RenderHeightRange = render_range;
 
-			if (count == GlCore::g_MaxRenderedObjCount)
-				GlCore::DispatchBlockRendering(position_buf, texindex_buf, count);
-		}
+	s32 solid_height = s_MaxHeight;
+	for (u32 x = 0; x < s_ChunkWidthAndHeight; x++)
+		for (u32 z = 0; z < s_ChunkWidthAndHeight; z++)
+			solid_height = std::min(solid_height, SolidColumnHeight(x, z));
+	m_SolidHeight = solid_height;
+
+	//Faces are grouped in one bucket for each direction
+	for (u32 face = 0; face < 6; face++)
+	{
+		m_FaceBuckets[face] = static_cast<u32>(instances.size());
+		if (greedy)
+			AppendGreedyFaces(instances, face);
 		else
-		{
-			//For depth drawcalls, we include every surface block
-			if (!block.HasNormals())
-				continue;
+			AppendBlockFaces(instances, face);
+	}
+	m_FaceBuckets[6] = static_cast<u32>(instances.size());
+}
+
+void Chunk::ComputeSectionConnectivity(u32 section)
+{
+	constexpr s32 side = static_cast<s32>(s_ChunkWidthAndHeight);
+	const s32 base_y = static_cast<s32>(section * s_ChunkWidthAndHeight);
+	std::array<u8, 6>& connectivity = m_SectionConnectivity[section];
+
+	//Sections above the generated terrain with no blocks are fully open
+	if (m_Sections[section].block_indices.empty() && base_y >= static_cast<s32>(lower_threshold)) {
+		connectivity.fill(0x3F);
+		return;
+	}
 
-			position_buf[count++] = ToWorld(block.position);
+	//Cells are indexed by (y * 16 + x) * 16 + z
+	std::bitset<s_SectionVolume> open, visited;
+	for (s32 y = 0; y < side; y++)
+		for (s32 x = 0; x < side; x++)
+			for (s32 z = 0; z < side; z++)
+				open[(y * side + x) * side + z] = !IsSolid(glm::ivec3(x, base_y + y, z));
 
-			if (count == GlCore::g_MaxRenderedObjCount)
-				GlCore::DispatchDepthRendering(position_buf, count);
+	connectivity.fill(0);
+	std::array<u16, s_SectionVolume> stack;
+	for (u32 start = 0; start < s_SectionVolume; start++)
+	{
+		if (!open[start] || visited[start])
+			continue;
+
+		//Faces of the section touched by this group of empty cells
+		u8 faces = 0;
+		u32 stack_size = 0;
+		stack[stack_size++] = static_cast<u16>(start);
+		visited[start] = true;
+		while (stack_size > 0)
+		{
+			const u32 cell = stack[--stack_size];
+			const glm::ivec3 pos(cell / side % side, cell / (side * side), cell % side);
+			for (u32 normal = 0; normal < 6; normal++)
+			{
+				const glm::ivec3 next = pos + glm::ivec3(Block::NormalForIndex(normal));
+				if (next.x < 0 || next.y < 0 || next.z < 0 || next.x >= side || next.y >= side || next.z >= side) {
+					faces |= 1 << normal;
+					continue;
+				}
+
+				const u32 next_cell = (next.y * side + next.x) * side + next.z;
+				if (open[next_cell] && !visited[next_cell]) {
+					visited[next_cell] = true;
+					stack[stack_size++] = static_cast<u16>(next_cell);
+				}
+			}
 		}
+
+		for (u32 normal = 0; normal < 6; normal++)
+			if (faces & (1 << normal))
+				connectivity[normal] |= faces;
 	}
 }
 
-void Chunk::RenderDrops()
+void Chunk::BuildMeshUpdate(ChunkMeshUpdate& update, bool greedy)
 {
-	for (auto& drop : m_LocalDrops)
-		drop.Render();
+	BuildInstances(update.instances, greedy);
+	update.chunk_coords = ChunkCoords();
+	update.chunk_origin = ChunkOrigin2D();
+	update.face_buckets = m_FaceBuckets;
+	update.face_height_range = m_FaceHeightRange;
+	update.shadow_changed = m_Changes.Consume(Changes::Shadow);
+
+	update.water_changed = m_WaterChanged;
+	if (m_WaterChanged)
+		update.water_rects.assign(m_WaterRects.begin(), m_WaterRects.end());
+	m_WaterChanged = false;
 }
 
-void Chunk::AddNewExposedNormals(const glm::vec3& block_pos, bool side_chunk_check)
+bool Chunk::FillRenderRecord(ChunkRenderRecord& record) const
 {
-	auto compute_new_normals = [&](const glm::vec3& pos, const glm::vec3& norm)
-	{
-		glm::vec3 neighbor_pos = pos + norm;
-		auto local_iter = std::find_if(chunk_blocks.begin(), chunk_blocks.end(),
-			[neighbor_pos, this](const Block& b) {return ToWorld(b.position) == neighbor_pos; });
+	if (!RenderBounds(record.bounds_min, record.bounds_max))
+		return false;
+
+	record.chunk_coords = ChunkCoords();
+	record.origin = ChunkOrigin2D();
+	record.center = glm::vec2(m_ChunkCenter.x, m_ChunkCenter.z);
+	record.solid_height = m_SolidHeight;
+	record.selected_block = -1;
+	record.first_occluder = 0;
+	record.occluder_count = 0;
+	record.connectivity = m_SectionConnectivity;
+	return true;
+}
 
-		//Behaviour between chunks
-		if (local_iter == chunk_blocks.end())
+void Chunk::BuildWaterRects()
+{
+	m_WaterRects.clear();
+	m_WaterChanged = true;
+	if (m_WaterLayerPositions.empty())
+		return;
+
+	//One row mask for each z, layers at different heights are merged separately
+	Utils::Vector<glm::ivec3> layers;
+	layers.reserve(m_WaterLayerPositions.size());
+	for (const glm::vec3& position : m_WaterLayerPositions)
+		layers.emplace_back(position.x - m_ChunkOrigin.x, position.y, position.z - m_ChunkOrigin.z);
+	std::sort(layers.begin(), layers.end(), [](const glm::ivec3& a, const glm::ivec3& b) { return a.y < b.y; });
+
+	for (u32 begin = 0; begin < layers.size();)
+	{
+		const s32 y = layers[begin].y;
+		std::array<u16, s_ChunkWidthAndHeight> rows{};
+		u32 end = begin;
+		for (; end < layers.size() && layers[end].y == y; end++)
+			rows[layers[end].z] |= static_cast<u16>(1u << layers[end].x);
+
+		//Greedy: the longest run along x, then extended along z while the rows below hold it entirely
+		for (u32 z = 0; z < s_ChunkWidthAndHeight; z++)
 		{
-			if (!side_chunk_check)
+			while (rows[z] != 0)
 			{
-				if (m_PlusX.has_value() && norm == glm::vec3(1.0f, 0.0f, 0.0f))
-					m_RelativeWorld.GetChunk(m_PlusX.value())->AddNewExposedNormals(pos, true);
-				if (m_MinusX.has_value() && norm == glm::vec3(-1.0f, 0.0f, 0.0f))
-					m_RelativeWorld.GetChunk(m_MinusX.value())->AddNewExposedNormals(pos, true);
-				if (m_PlusZ.has_value() && norm == glm::vec3(0.0f, 0.0f, 1.0f))
-					m_RelativeWorld.GetChunk(m_PlusZ.value())->AddNewExposedNormals(pos, true);
-				if (m_MinusZ.has_value() && norm == glm::vec3(0.0f, 0.0f, -1.0f))
-					m_RelativeWorld.GetChunk(m_MinusZ.value())->AddNewExposedNormals(pos, true);
+				u32 x = 0;
+				while (!(rows[z] & (1u << x)))
+					x++;
+				u32 width = 0;
+				while (x + width < s_ChunkWidthAndHeight && (rows[z] & (1u << (x + width))))
+					width++;
+
+				const u16 span = static_cast<u16>(((1u << width) - 1) << x);
+				u32 depth = 1;
+				while (z + depth < s_ChunkWidthAndHeight && (rows[z + depth] & span) == span)
+					depth++;
+
+				for (u32 k = z; k < z + depth; k++)
+					rows[k] &= static_cast<u16>(~span);
+				m_WaterRects.push_back(GlCore::PackBlockInstance(glm::u8vec3(x, y, z), 2, 0, width, depth));
 			}
 		}
-		else
-		{
-			local_iter->AddNormal(-norm);
-		}
-	};
 
-	compute_new_normals(block_pos, glm::vec3( 1.0f, 0.0f, 0.0f));
-	compute_new_normals(block_pos, glm::vec3(-1.0f, 0.0f, 0.0f));
-	compute_new_normals(block_pos, glm::vec3( 0.0f, 1.0f, 0.0f));
-	compute_new_normals(block_pos, glm::vec3(0.0f, -1.0f, 0.0f));
-	compute_new_normals(block_pos, glm::vec3( 0.0f, 0.0f, 1.0f));
-	compute_new_normals(block_pos, glm::vec3(0.0f, 0.0f, -1.0f));
+		begin = end;
+	}
+}
+
+void Chunk::AppendBlockFaces(Utils::Vector<u32>& instances, u32 face) const
+{
+	//One packed instance for each exposed face, hidden faces never reach the rasterizer
+	for (auto& block : chunk_blocks)
+		if (block.exposed_normals & (1 << face))
+			instances.push_back(GlCore::PackBlockInstance(block.position, face, static_cast<u32>(block.Type())));
 }
 
-void Chunk::AddWaterLayerIfPresent(glm::vec3* buffer, u32& count)
+void Chunk::AppendGreedyFaces(Utils::Vector<u32>& instances, u32 face) const
 {
-	if (!m_WaterLayerPositions.empty()) {
-		std::memcpy(buffer + count, m_WaterLayerPositions.data(), m_WaterLayerPositions.size() * sizeof(glm::vec3));
-		count += m_WaterLayerPositions.size();
+	if (m_FaceHeightRange.y < 0)
+		return;
+
+	//Axes of the face plane (u, v) and the one along its normal (slices), the same
+	//order used by face_plane_axes in the block shaders
+	static constexpr std::array<glm::ivec3, 3> axis_orders{ glm::ivec3(2, 1, 0), glm::ivec3(0, 2, 1), glm::ivec3(0, 1, 2) };
+	const glm::ivec3 axes = axis_orders[face / 2];
+	//y is limited to the blocks with exposed faces
+	const glm::ivec3 begin(0, m_FaceHeightRange.x, 0);
+	const glm::ivec3 size(s_ChunkWidthAndHeight, m_FaceHeightRange.y - m_FaceHeightRange.x + 1, s_ChunkWidthAndHeight);
+	const s32 u_size = size[axes.x], v_size = size[axes.y], slice_count = size[axes.z];
+	const s32 plane_size = u_size * v_size;
+
+	//Texture index + 1 of the exposed face in each cell, 0 if there is none
+	std::array<u8, s_ChunkWidthAndHeight * s_ChunkWidthAndHeight * s_MaxHeight> mask;
+	std::fill_n(mask.begin(), plane_size * slice_count, 0);
+	for (auto& block : chunk_blocks)
+	{
+		if (!(block.exposed_normals & (1 << face)))
+			continue;
+
+		const glm::ivec3 cell = glm::ivec3(block.position) - begin;
+		mask[cell[axes.z] * plane_size + cell[axes.y] * u_size + cell[axes.x]] = static_cast<u8>(block.Type()) + 1;
+	}
+
+	for (s32 slice = 0; slice < slice_count; slice++)
+	{
+		u8* plane = mask.data() + slice * plane_size;
+		for (s32 v = 0; v < v_size; v++)
+		{
+			for (s32 u = 0; u < u_size; u++)
+			{
+				const u8 type = plane[v * u_size + u];
+				if (!type)
+					continue;
+
+				//Grow along u first, then add rows as long as they match entirely
+				s32 width = 1;
+				while (u + width < u_size && width < s_MaxQuadSize && plane[v * u_size + u + width] == type)
+					width++;
+
+				s32 height = 1;
+				for (; v + height < v_size && height < s_MaxQuadSize; height++)
+				{
+					const u8* row = plane + (v + height) * u_size + u;
+					if (std::any_of(row, row + width, [type](u8 cell) { return cell != type; }))
+						break;
+				}
+
+				for (s32 dv = 0; dv < height; dv++)
+					std::fill_n(plane + (v + dv) * u_size + u, width, 0);
+
+				glm::ivec3 position;
+				position[axes.x] = u;
+				position[axes.y] = v;
+				position[axes.z] = slice;
+				position += begin;
+				instances.push_back(GlCore::PackBlockInstance(glm::u8vec3(position), face, type - 1, width, height));
+			}
+		}
 	}
 }
 
@@ -768,39 +731,324 @@ u32 Chunk::SectorIndex() const
 	return m_SectorIndex;
 }
 
-void Chunk::EmplaceLowerBlockStack(u16 stack_count)
+bool Chunk::IsImplicitBlock(const glm::ivec3& local_pos) const
 {
-	//Emplaces a new stack of some blocks
-	s16 block_stack_size = 7;
-	auto& generations = m_RelativeWorld.perlin_generations;
-	u64 chunk_hash = Hash(glm::vec2(m_ChunkOrigin.x, m_ChunkOrigin.z));
-	for (u16 stacks_count = 0; stacks_count < stack_count; stacks_count++) {
-		//At the moment, do not create blocks below 0
-		s16 actual_size = lower_threshold >= 7 ? block_stack_size : static_cast<s16>(lower_threshold);
-		if (actual_size == 0)
-			return;
+	//Nothing is generated below the world floor
+	if (local_pos.y < 0 || local_pos.y >= static_cast<s32>(lower_threshold))
+		return false;
+
+	u32 index = UndergroundCellIndex(local_pos);
+	return !(m_MaterializedCells[index / 64] & (1ull << (index % 64)));
+}
+
+bool Chunk::MaterializeBlock(const glm::ivec3& local_pos)
+{
+	if (!IsImplicitBlock(local_pos))
+		return false;
+
+	MaterializeCell(local_pos);
+	ComputeBlockFaces(chunk_blocks.back());
+	return true;
+}
+
+void Chunk::MaterializeCell(const glm::ivec3& local_pos)
+{
+	u32 index = UndergroundCellIndex(local_pos);
+	m_MaterializedCells[index / 64] |= (1ull << (index % 64));
+
+	//No need to keep the column ordering here, blocks are simply pushed at the end
+	InsertBlock(local_pos, ImplicitBlockType(local_pos));
+}
+
+Defs::Item Chunk::ImplicitBlockType(const glm::ivec3& local_pos) const
+{
+	const auto& generations = m_RelativeWorld.perlin_generations;
+	auto iter = generations.find(Hash(ChunkOrigin2D()));
+	MC_ASSERT(iter != generations.end(), "This generation should exist");
+
+	return iter->second.biomes[local_pos.x * s_ChunkWidthAndHeight + local_pos.z] == Defs::Biome::Plains ?
+		Defs::Item::Stone :
+		Defs::Item::Sand;
+}
+
+std::optional<Defs::Item> Chunk::BlockTypeAt(const glm::ivec3& local_pos) const
+{
+	if (u32 index = BlockIndexAt(local_pos); index != s_NoBlock)
+		return chunk_blocks[index].Type();
+
+	if (IsImplicitBlock(local_pos))
+		return ImplicitBlockType(local_pos);
+
+	return std::nullopt;
+}
+
+bool Chunk::PlaceBlock(const glm::ivec3& local_pos, Defs::Item type)
+{
+	if (local_pos.y < 0 || local_pos.y >= static_cast<s32>(s_MaxHeight) || IsSolid(local_pos))
+		return false;
+
+	InsertBlock(local_pos, type);
+	//Computes the new block's faces and hides the ones it now covers
+	UpdateFacesAround(local_pos);
+	return true;
+}
 
-		MC_ASSERT(generations.find(chunk_hash) != generations.end(), "This generation should exist");
+std::optional<Defs::Item> Chunk::BreakBlock(const glm::ivec3& local_pos)
+{
+	//Underground blocks need a real representation before being removed
+	MaterializeBlock(local_pos);
+
+	u32 index = BlockIndexAt(local_pos);
+	if (index == s_NoBlock)
+		return std::nullopt;
+
+	const Defs::Item type = chunk_blocks[index].Type();
+	RemoveBlock(index);
+
+	//Blocks below the lower threshold are only solid by generation, give a real
+	//representation only to the ones which are now exposed by the hole
+	MaterializeNeighbors(local_pos);
+	//Only the 6 neighbors of the hole can gain a face
+	UpdateFacesAround(local_pos);
+	return type;
+}
 
+u32 Chunk::ApplyRegionEdit(const Defs::RegionEdit& edit)
+{
+	const glm::ivec3 origin(m_ChunkOrigin);
+	const s32 last = static_cast<s32>(s_ChunkWidthAndHeight) - 1;
+	const glm::ivec3 begin = glm::max(edit.min - origin, glm::ivec3(0));
+	const glm::ivec3 end = glm::min(edit.max - origin, glm::ivec3(last, s_MaxHeight - 1, last));
 
-		auto iter = chunk_blocks.begin();
-		for (u32 x = 0; x < s_ChunkWidthAndHeight; x++) {
-			for (u32 z = 0; z < s_ChunkWidthAndHeight; z++) {
-				for (s16 y = static_cast<s16>(lower_threshold - 1); y >= static_cast<s16>(lower_threshold - actual_size); y--) {
-					Defs::Item type = generations[chunk_hash].biomes[x * s_ChunkWidthAndHeight + z] == Defs::Biome::Plains ?
-						Defs::Item::Stone :
-						Defs::Item::Sand;
+	u32 edited = 0;
+	for (s32 y = begin.y; y <= end.y; y++)
+	{
+		for (s32 x = begin.x; x <= end.x; x++)
+		{
+			for (s32 z = begin.z; z <= end.z; z++)
+			{
+				const glm::ivec3 local_pos(x, y, z);
+				if (!edit.Contains(origin + local_pos))
+					continue;
 
-					iter = chunk_blocks.emplace(iter, glm::u8vec3(x, y, z), type);
+				const std::optional<Defs::Item> current = BlockTypeAt(local_pos);
+				switch (edit.operation)
+				{
+				case Defs::EditOperation::Fill:
+					if (current != edit.type && WriteCell(local_pos, edit.type))
+						edited++;
+					break;
+				case Defs::EditOperation::Replace:
+					if (current == edit.replaced_type && WriteCell(local_pos, edit.type))
+						edited++;
+					break;
+				case Defs::EditOperation::Clear:
+					if (current.has_value() && WriteCell(local_pos, std::nullopt))
+						edited++;
+					break;
 				}
+			}
+		}
+	}
+
+	return edited;
+}
+
+void Chunk::CollectExposedCells(const Defs::RegionEdit& edit, Utils::Vector<glm::ivec3>& exposed_cells)
+{
+	//Only the region grown by one block can expose the underground
+	const glm::ivec3 origin(m_ChunkOrigin);
+	const s32 last = static_cast<s32>(s_ChunkWidthAndHeight) - 1;
+	const glm::ivec3 begin = glm::max(edit.min - origin - glm::ivec3(1), glm::ivec3(0));
+	const glm::ivec3 end = glm::min(edit.max - origin + glm::ivec3(1), glm::ivec3(last, static_cast<s32>(lower_threshold) - 1, last));
+
+	Chunk* side_chunks[4];
+	SideChunks(side_chunks);
 
-				while (iter != chunk_blocks.end() && iter->position.x == x && iter->position.z == z)
-					iter++;
+	for (s32 y = begin.y; y <= end.y; y++)
+	{
+		for (s32 x = begin.x; x <= end.x; x++)
+		{
+			for (s32 z = begin.z; z <= end.z; z++)
+			{
+				const glm::ivec3 local_pos(x, y, z);
+				if (!IsImplicitBlock(local_pos))
+					continue;
+
+				for (const glm::ivec3& offset : neighbor_offsets)
+				{
+					glm::ivec3 pos = local_pos + offset;
+					Chunk* chunk = CrossBorder(pos, side_chunks);
+					if (chunk && !chunk->IsSolid(pos)) {
+						exposed_cells.push_back(local_pos);
+						break;
+					}
+				}
 			}
 		}
+	}
+}
+
+void Chunk::RebuildFaces()
+{
+	Chunk* side_chunks[4];
+	SideChunks(side_chunks);
+
+	for (Block& block : chunk_blocks)
+	{
+		for (u32 i = 0; i < neighbor_offsets.size(); i++)
+		{
+			glm::ivec3 pos = glm::ivec3(block.position) + neighbor_offsets[i];
+			Chunk* chunk = CrossBorder(pos, side_chunks);
+			SetBlockFace(block, i, chunk && !chunk->IsSolid(pos));
+		}
+	}
+}
+
+bool Chunk::WriteCell(const glm::ivec3& local_pos, std::optional<Defs::Item> type)
+{
+	const bool implicit = IsImplicitBlock(local_pos);
+	const u32 index = BlockIndexAt(local_pos);
+	if (!type.has_value() && !implicit && index == s_NoBlock)
+		return false;
+
+	//From now on the position is not solid by generation anymore
+	if (implicit) {
+		u32 cell = UndergroundCellIndex(local_pos);
+		m_MaterializedCells[cell / 64] |= (1ull << (cell % 64));
+	}
+
+	if (index != s_NoBlock)
+		RemoveBlock(index);
 
-		lower_threshold -= actual_size;
+	if (type.has_value()) {
+		InsertBlock(local_pos, type.value());
+	}
+	else if (implicit) {
+		//RemoveBlock already handles this for explicit blocks
+		SetBorderBit(local_pos, false);
+		if (local_pos.y == ColumnHeight(local_pos.x, local_pos.z))
+			RefreshColumnHeight(local_pos.x, local_pos.z);
+		MarkChanged(Changes::g_BlockChange, local_pos.y);
 	}
+
+	return true;
+}
+
+void Chunk::SideChunks(Chunk* side_chunks[4])
+{
+	const glm::ivec2 coords = ChunkCoords();
+	side_chunks[0] = m_RelativeWorld.ChunkAt(coords + glm::ivec2(1, 0));
+	side_chunks[1] = m_RelativeWorld.ChunkAt(coords + glm::ivec2(-1, 0));
+	side_chunks[2] = m_RelativeWorld.ChunkAt(coords + glm::ivec2(0, 1));
+	side_chunks[3] = m_RelativeWorld.ChunkAt(coords + glm::ivec2(0, -1));
+}
+
+Chunk* Chunk::CrossBorder(glm::ivec3& local_pos, Chunk* const side_chunks[4])
+{
+	//Positions only exceed the chunk by one block along a single axis
+	const s32 side = static_cast<s32>(s_ChunkWidthAndHeight);
+	if (local_pos.x >= side) {
+		local_pos.x -= side;
+		return side_chunks[0];
+	}
+	if (local_pos.x < 0) {
+		local_pos.x += side;
+		return side_chunks[1];
+	}
+	if (local_pos.z >= side) {
+		local_pos.z -= side;
+		return side_chunks[2];
+	}
+	if (local_pos.z < 0) {
+		local_pos.z += side;
+		return side_chunks[3];
+	}
+
+	return this;
+}
+
+void Chunk::MaterializeNeighbors(const glm::ivec3& local_pos)
+{
+	for (const glm::ivec3& offset : neighbor_offsets)
+	{
+		glm::ivec3 pos = local_pos + offset;
+		if (Chunk* chunk = ResolveNeighbor(pos))
+			chunk->MaterializeBlock(pos);
+	}
+}
+
+u32 Chunk::BlockIndexAt(const glm::ivec3& local_pos) const
+{
+	if (local_pos.y < 0 || local_pos.y >= static_cast<s32>(s_MaxHeight))
+		return s_NoBlock;
+
+	const ChunkSection& section = m_Sections[local_pos.y / s_ChunkWidthAndHeight];
+	if (section.block_indices.empty())
+		return s_NoBlock;
+
+	return section.block_indices[SectionCellIndex(local_pos)];
+}
+
+bool Chunk::IsSolid(const glm::ivec3& local_pos) const
+{
+	//The world floor is never exposed
+	if (local_pos.y < 0)
+		return true;
+
+	return BlockIndexAt(local_pos) != s_NoBlock || IsImplicitBlock(local_pos);
+}
+
+Block& Chunk::InsertBlock(const glm::ivec3& local_pos, Defs::Item type)
+{
+	MC_ASSERT(chunk_blocks.size() < s_NoBlock, "Too many blocks for the section indices");
+	MC_ASSERT(local_pos.y >= 0 && local_pos.y < static_cast<s32>(s_MaxHeight), "Block out of the chunk bounds");
+
+	SetBlockIndex(local_pos, chunk_blocks.size());
+	SetBorderBit(local_pos, true);
+
+	s16& height = m_Heightmap[local_pos.x * s_ChunkWidthAndHeight + local_pos.z];
+	height = std::max(height, static_cast<s16>(local_pos.y));
+	Block& block = chunk_blocks.emplace_back(glm::u8vec3(local_pos), type);
+	MarkChanged(Changes::g_BlockChange, local_pos.y);
+	return block;
+}
+
+void Chunk::RemoveBlock(u32 index)
+{
+	MC_ASSERT(index < chunk_blocks.size(), "provided index out of bounds");
+
+	const glm::ivec3 removed_pos(chunk_blocks[index].position);
+	const u32 last_index = chunk_blocks.size() - 1;
+	if (index != last_index) {
+		chunk_blocks[index] = chunk_blocks[last_index];
+		SetBlockIndex(glm::ivec3(chunk_blocks[index].position), index);
+	}
+
+	chunk_blocks.pop_back();
+	SetBlockIndex(removed_pos, s_NoBlock);
+	SetBorderBit(removed_pos, false);
+
+	if (removed_pos.y == ColumnHeight(removed_pos.x, removed_pos.z))
+		RefreshColumnHeight(removed_pos.x, removed_pos.z);
+	MarkChanged(Changes::g_BlockChange, removed_pos.y);
+}
+
+Chunk* Chunk::ResolveNeighbor(glm::ivec3& local_pos)
+{
+	const s32 side = static_cast<s32>(s_ChunkWidthAndHeight);
+	glm::ivec2 offset(0);
+	if (local_pos.x < 0) offset.x = -1;
+	else if (local_pos.x >= side) offset.x = 1;
+	if (local_pos.z < 0) offset.y = -1;
+	else if (local_pos.z >= side) offset.y = 1;
+
+	if (offset == glm::ivec2(0))
+		return this;
+
+	local_pos.x -= offset.x * side;
+	local_pos.z -= offset.y * side;
+	return m_RelativeWorld.ChunkAt(ChunkCoords() + offset);
 }
 
 u32 Chunk::Index() const
@@ -823,6 +1071,13 @@ const Utils::Serializer& Chunk::Serialize(const Utils::Serializer& sz)
 	sz& m_ChunkIndex;
 	//World address does not need to be serialized
 
+	//The implicit underground region is described by its threshold and by the positions
+	//which were already materialized
+	sz& lower_threshold;
+	sz& m_MaterializedCells.size();
+	for (u64 cells : m_MaterializedCells)
+		sz& cells;
+
 	if (!chunk_blocks.empty())
 	{
 		const glm::vec3& base_vec = m_ChunkOrigin;
@@ -862,6 +1117,17 @@ const Utils::Serializer& Chunk::Deserialize(const Utils::Serializer& sz)
 
 	sz% m_ChunkIndex;
 
+	u64 materialized_size;
+	sz% lower_threshold;
+	sz% materialized_size;
+	m_MaterializedCells.resize(materialized_size);
+	for (u64& cells : m_MaterializedCells)
+		sz% cells;
+
+	//The column data is not serialized, it is rebuilt from the blocks
+	m_Heightmap.fill(static_cast<s16>(lower_threshold) - 1);
+	m_LowestExposed.fill(static_cast<s16>(s_MaxHeight));
+
 	if (blk_vec_size != 0)
 	{
 		chunk_blocks.clear();
@@ -877,8 +1143,7 @@ const Utils::Serializer& Chunk::Deserialize(const Utils::Serializer& sz)
 			sz% norm_payload;
 			sz% item_type;
 
-			chunk_blocks.emplace_back(v, static_cast<Defs::Item>(item_type));
-			auto& bb = chunk_blocks.back();
+			auto& bb = InsertBlock(glm::ivec3(v), static_cast<Defs::Item>(item_type));
 			bb.exposed_normals = norm_payload;
 		}
 	}
@@ -894,6 +1159,20 @@ const Utils::Serializer& Chunk::Deserialize(const Utils::Serializer& sz)
 	sz% m_ChunkOrigin.x% m_ChunkOrigin.z;
 	m_ChunkOrigin.y = 0.0f;
 
+	//Explicit blocks already set their border bits while being inserted
+	InitImplicitBorderRows();
+
+	//Carved underground columns can be lower than the threshold
+	for (s32 x = 0; x < static_cast<s32>(s_ChunkWidthAndHeight); x++)
+		for (s32 z = 0; z < static_cast<s32>(s_ChunkWidthAndHeight); z++)
+			RefreshColumnHeight(x, z);
+
+	for (const Block& block : chunk_blocks) {
+		s16& lowest = m_LowestExposed[block.position.x * s_ChunkWidthAndHeight + block.position.z];
+		if (block.HasNormals())
+			lowest = std::min(lowest, static_cast<s16>(block.position.y));
+	}
+
 	//Calculate chunk center
 	m_ChunkCenter = m_ChunkOrigin + GetHalfWayVector();
 
@@ -907,73 +1186,156 @@ const Utils::Serializer& Chunk::Deserialize(const Utils::Serializer& sz)
 	return sz;
 }
 
-bool Chunk::IsBlock(const glm::vec3& pos, s32 starting_index, bool search_towards_end, u32* block_index) const
+u32 Chunk::UndergroundCellIndex(const glm::ivec3& local_pos)
 {
-	MC_ASSERT(starting_index >= 0 && starting_index < chunk_blocks.size(), "provided index out of bounds");
+	return (local_pos.y * s_ChunkWidthAndHeight + local_pos.x) * s_ChunkWidthAndHeight + local_pos.z;
+}
 
-	if (search_towards_end)
+u32 Chunk::SectionCellIndex(const glm::ivec3& local_pos)
+{
+	return ((local_pos.y % s_ChunkWidthAndHeight) * s_ChunkWidthAndHeight + local_pos.x) * s_ChunkWidthAndHeight + local_pos.z;
+}
+
+void Chunk::SetBlockIndex(const glm::ivec3& local_pos, u32 index)
+{
+	ChunkSection& section = m_Sections[local_pos.y / s_ChunkWidthAndHeight];
+	if (section.block_indices.empty()) {
+		//Clearing a position of an empty section does not need any allocation
+		if (index == s_NoBlock)
+			return;
+
+		section.block_indices.resize(s_SectionVolume, s_NoBlock);
+	}
+
+	section.block_indices[SectionCellIndex(local_pos)] = index;
+}
+
+void Chunk::SetBorderBit(const glm::ivec3& local_pos, bool solid)
+{
+	const s32 last = static_cast<s32>(s_ChunkWidthAndHeight) - 1;
+	auto set_bit = [&](u32 plane, s32 bit)
+	{
+		u16& row = m_BorderPlanes[plane][local_pos.y];
+		if (solid)
+			row |= (1 << bit);
+		else
+			row &= ~(1 << bit);
+	};
+
+	//Corner positions belong to two planes
+	if (local_pos.x == last) set_bit(0, local_pos.z);
+	if (local_pos.x == 0) set_bit(1, local_pos.z);
+	if (local_pos.z == last) set_bit(2, local_pos.x);
+	if (local_pos.z == 0) set_bit(3, local_pos.x);
+}
+
+void Chunk::InitImplicitBorderRows()
+{
+	for (s32 y = 0; y < static_cast<s32>(lower_threshold); y++)
 	{
-		//Searching before in the defined batch
-		for (s32 i = starting_index; i < chunk_blocks.size(); i++)
+		for (u32 plane = 0; plane < m_BorderPlanes.size(); plane++)
 		{
-			if (ToWorld(chunk_blocks[i].position) == pos)
+			for (s32 bit = 0; bit < static_cast<s32>(s_ChunkWidthAndHeight); bit++)
 			{
-				if (block_index)
-					*block_index = i;
-
-				return true;
+				const glm::ivec3 pos = BorderPosition(plane, y, bit);
+				if (IsImplicitBlock(pos))
+					SetBorderBit(pos, true);
 			}
 		}
-
 	}
-	else
+}
+
+void Chunk::ExchangeBorderFaces(Chunk& side_chunk, const Defs::ChunkLocation& cl)
+{
+	const u32 plane = BorderPlaneIndex(cl);
+	const u32 facing_plane = plane ^ 1;
+	//Normal of the faces pointing towards the side chunk, the y normals sit between the x and z ones
+	const u32 normal = plane < 2 ? plane : plane + 2;
+
+	for (s32 y = 0; y < static_cast<s32>(s_MaxHeight); y++)
 	{
-		for (s32 i = starting_index; i >= 0; i--)
+		const u16 local_row = m_BorderPlanes[plane][y];
+		const u16 side_row = side_chunk.m_BorderPlanes[facing_plane][y];
+		if ((local_row | side_row) == 0)
+			continue;
+
+		//Positions which are solid on both sides hide each other
+		const u16 hidden = local_row & side_row;
+		for (s32 bit = 0; bit < static_cast<s32>(s_ChunkWidthAndHeight); bit++)
 		{
-			if (ToWorld(chunk_blocks[i].position) == pos)
-			{
-				if (block_index)
-					*block_index = i;
+			const u16 mask = 1 << bit;
+			if (local_row & mask) {
+				if (u32 index = BlockIndexAt(BorderPosition(plane, y, bit)); index != s_NoBlock)
+					SetBlockFace(chunk_blocks[index], normal, !(hidden & mask));
+			}
 
-				return true;
+			if (side_row & mask) {
+				if (u32 index = side_chunk.BlockIndexAt(BorderPosition(facing_plane, y, bit)); index != s_NoBlock)
+					side_chunk.SetBlockFace(side_chunk.chunk_blocks[index], normal ^ 1, !(hidden & mask));
 			}
 		}
 	}
+}
 
-	return false;
+void Chunk::MarkChanged(u8 kinds, s32 y)
+{
+	PublishChanges(m_Changes.Mark(kinds, y / s_ChunkWidthAndHeight));
 }
 
-Block& Chunk::GetBlock(u32 index)
+void Chunk::MarkAllChanged(u8 kinds)
 {
-	return chunk_blocks[index];
+	PublishChanges(m_Changes.MarkAll(kinds));
 }
 
-const Block& Chunk::GetBlock(u32 index) const
+void Chunk::StartPublishingChanges()
 {
-	return chunk_blocks[index];
+	m_PublishChanges = true;
+	PublishChanges(m_Changes.Kinds());
 }
 
-bool Chunk::BorderCheck(Chunk* chunk, const glm::vec3& pos, u32 top_index, u32 bot_index, bool search_dir)
+void Chunk::PublishChanges(u8 raised_kinds)
 {
-	bool local_found = false, adjacent_found = false;
-	u32 blk_index;
-	local_found = IsBlock(ToWorld(chunk_blocks[top_index].position) + pos, bot_index, search_dir, &blk_index);
-	if (!local_found)
-			adjacent_found = chunk && chunk->IsBlock(ToWorld(chunk_blocks[top_index].position) + pos, 0, true, &blk_index);
+	//Only the first change of each kind is published, the consumer reads the rest from the tracker
+	if (raised_kinds != 0 && m_PublishChanges)
+		m_RelativeWorld.PublishChanges(*this, raised_kinds);
+}
 
-	if (local_found) {
-		if (chunk_blocks[blk_index].Type() != Defs::Item::Leaves)
-			return true;
-	}
-	else if (adjacent_found) {
-		if (chunk->GetBlock(blk_index).Type() != Defs::Item::Leaves)
-			return true;
-	}
-	else {
-		chunk_blocks[top_index].AddNormal(pos);
+void Chunk::SetBlockFace(Block& block, u32 normal, bool exposed)
+{
+	const u8 previous_normals = block.exposed_normals;
+	block.SetNormal(normal, exposed);
+	if (block.exposed_normals != previous_normals)
+		MarkChanged(Changes::g_FaceChange, block.position.y);
+
+	if (exposed) {
+		s16& lowest = m_LowestExposed[block.position.x * s_ChunkWidthAndHeight + block.position.z];
+		lowest = std::min(lowest, static_cast<s16>(block.position.y));
 	}
+}
+
+void Chunk::RefreshColumnHeight(s32 x, s32 z)
+{
+	s16& height = m_Heightmap[x * s_ChunkWidthAndHeight + z];
+	while (height >= 0 && !IsSolid(glm::ivec3(x, height, z)))
+		height--;
+}
 
-	return false;
+u32 Chunk::BorderPlaneIndex(const Defs::ChunkLocation& cl)
+{
+	MC_ASSERT(cl != Defs::ChunkLocation::None, "A border plane needs a side");
+	return static_cast<u32>(cl) - 1;
+}
+
+glm::ivec3 Chunk::BorderPosition(u32 plane, s32 y, s32 bit)
+{
+	const s32 last = static_cast<s32>(s_ChunkWidthAndHeight) - 1;
+	switch (plane)
+	{
+	case 0: return glm::ivec3(last, y, bit);
+	case 1: return glm::ivec3(0, y, bit);
+	case 2: return glm::ivec3(bit, y, last);
+	default: return glm::ivec3(bit, y, 0);
+	}
 }
 
 u64 Chunk::Hash(glm::vec2 v) 
@@ -1,11 +1,16 @@
 #pragma once
 #include <optional>
+#include <atomic>
 #include "glm/glm.hpp"
 
 #include "GameDefinitions.h"
 #include "Block.h"
 #include "State.h"
 #include "Memory.h"
+#include "Renderer.h"
+#include "Culling.h"
+#include "ChangeTracking.h"
+#include "RenderPacket.h"
 
 class World;
 class Inventory;
@@ -20,6 +25,14 @@ struct ChunkGeneration
 
 ChunkGeneration ComputeGeneration(Defs::WorldSeed& seed, f32 origin_x, f32 origin_z);
 
+//Vertical 16x16x16 slice of a chunk, used to resolve a local position to its block in O(1)
+struct ChunkSection
+{
+	//Index in chunk_blocks of the block at each position of the section,
+	//allocated only once the section holds at least one block
+	Utils::Vector<u32> block_indices;
+};
+
 class Chunk
 {
 public:
@@ -38,35 +51,80 @@ public:
 	Chunk& operator=(const Chunk&) = delete;
 	Chunk& operator=(Chunk&& rhs) noexcept;
 
-	//Stores render data and presents it if the buffers are full
-	void ForwardRenderableData(glm::vec3*& position_buf, u32*& texindex_buf, u32& count, bool depth_buf_draw, bool selected = false) const;
-	void RenderDrops();
+	//Packs the exposed faces of the chunk sorted by direction and clears the dirty flag,
+	//one quad per block face or greedily merged quads. Can run on worker threads
+	void BuildInstances(Utils::Vector<u32>& instances, bool greedy);
+	//Builds the faces and fills the update sent to the render thread, consuming the shadow
+	//and water changes. Can run on worker threads
+	void BuildMeshUpdate(ChunkMeshUpdate& update, bool greedy);
+	//Copies the data needed by the render thread, returns false if the chunk has nothing to draw
+	bool FillRenderRecord(ChunkRenderRecord& record) const;
 
 	//Normals loaded as the chunk spawns
 	void InitGlobalNorms();
-	//Add new normals for a newly placed block
-	void AddFreshNormals(Block& b);
-	//Add new normals after a block deletion
-	void AddNewExposedNormals(const glm::vec3& block_pos, bool side_chunk_check = false);
-	void AddWaterLayerIfPresent(glm::vec3* buffer, u32& count);
+	//Adds or removes the faces of the block at local_pos and the facing sides of its 6 neighbors,
+	//meant to be called after the position has been filled or emptied
+	void UpdateFacesAround(const glm::ivec3& local_pos);
 
 	//Collision functions
 	[[nodiscard]] std::pair<f32, Defs::HitDirection> RayCollisionLogic(const glm::vec3& camera_position, const glm::vec3& camera_direction);
-	//Returns true if a collision happens on the xz axis
-	bool BlockCollisionLogic(glm::vec3& position);
+	//Returns true if a collision happens on the xz axis, the axes hit and the grounded state are added to collision
+	bool BlockCollisionLogic(glm::vec3& position, Physics::Collision& collision);
 
 
-	void UpdateBlocks(Inventory& inventory, f32 elapsed_time);
-	//Checks if this chunk is near enough to the player to be rendered
-	bool IsChunkRenderable(const glm::vec3& camera_position) const;
-	//Checks if this chunk (within the renderable space) is visible by the player
-	bool IsChunkVisible(const glm::vec3& camera_position, const glm::vec3& camera_direction) const;
+	//Checks if this chunk is near enough to the player to be rendered, the margin extends the distance
+	bool IsChunkRenderable(const glm::vec3& camera_position, f32 margin = 0.0f) const;
+	//World space box enclosing the built faces and the water layers, vertically as tight as the
+	//occupied heights. Returns false if the chunk has nothing to draw
+	bool RenderBounds(glm::vec3& min, glm::vec3& max) const;
+	//Pushes one box for each 4x4 group of columns, enclosing only blocks which are surely solid
+	void AppendOccluders(Culling::BoundsBatch& occluders) const;
+	//Highest y up to which every column of the chunk is surely solid as of the last build, negative if none
+	inline s32 SolidHeight() const { return m_SolidHeight; }
 	//Determines if the chunk is visible by the shadow shader
 	bool IsChunkVisibleByShadow(const glm::vec3& camera_position, const glm::vec3& camera_direction) const;
-	//Removes the defined normal from all chunk blocks which border
-	void RemoveBorderNorm(const glm::vec3& norm);
-	//Add blocks when needed
-	void EmplaceLowerBlockStack(u16 stack_count);
+	//Everything below lower_threshold is solid by generation and is not stored in chunk_blocks.
+	//Returns true if the local position lies in that region and was never materialized
+	bool IsImplicitBlock(const glm::ivec3& local_pos) const;
+	//Gives an implicit underground block an explicit representation, its faces are
+	//derived on demand from the surrounding blocks. Returns false if the block is not implicit
+	bool MaterializeBlock(const glm::ivec3& local_pos);
+	//Materializes the implicit blocks around a freshly broken block, also crossing chunk borders
+	void MaterializeNeighbors(const glm::ivec3& local_pos);
+
+	//O(1) block access in chunk space, s_NoBlock is returned for empty positions
+	u32 BlockIndexAt(const glm::ivec3& local_pos) const;
+	//Type of the block at the position, implicit underground blocks included. nullopt if empty
+	std::optional<Defs::Item> BlockTypeAt(const glm::ivec3& local_pos) const;
+	//Gameplay edits, they keep the faces, the underground region and the dirty flag consistent.
+	//PlaceBlock returns false if the position is occupied or out of bounds
+	bool PlaceBlock(const glm::ivec3& local_pos, Defs::Item type);
+	std::optional<Defs::Item> BreakBlock(const glm::ivec3& local_pos);
+
+	//Bulk edits run in passes so that every chunk can be processed by a different thread:
+	//cells are written without any face work, the underground exposed by the edit is collected
+	//and materialized, and finally the faces of every touched chunk are rebuilt once.
+	//Returns how many cells were changed
+	u32 ApplyRegionEdit(const Defs::RegionEdit& edit);
+	void CollectExposedCells(const Defs::RegionEdit& edit, Utils::Vector<glm::ivec3>& exposed_cells);
+	//Gives an implicit block a real representation without computing its faces
+	void MaterializeCell(const glm::ivec3& local_pos);
+	void RebuildFaces();
+	//True if the position holds an explicit block or is solid by generation
+	bool IsSolid(const glm::ivec3& local_pos) const;
+	//Pushes a new block and indexes it, the faces are not computed here
+	Block& InsertBlock(const glm::ivec3& local_pos, Defs::Item type);
+	//Removes the block by swapping it with the last one, so the other indices stay valid
+	void RemoveBlock(u32 index);
+	//Y of the highest solid block of the column, -1 if the column is empty
+	inline s32 ColumnHeight(u32 x, u32 z) const { return m_Heightmap[x * s_ChunkWidthAndHeight + z]; }
+	//Lower bound of the y of the lowest block of the column with a visible face, s_MaxHeight if none
+	inline s32 LowestExposed(u32 x, u32 z) const { return m_LowestExposed[x * s_ChunkWidthAndHeight + z]; }
+	//Highest y up to which the column is surely solid, negative if none
+	s32 SolidColumnHeight(u32 x, u32 z) const;
+	//Returns the chunk which owns a position that can exceed this chunk's borders by one block
+	//and converts the position to that chunk's space. nullptr if the chunk is not loaded
+	Chunk* ResolveNeighbor(glm::ivec3& local_pos);
 
 	//When loaded from the relative world, returns the indexed position of the adjacent chunks
 	const std::optional<u32>& GetLoadedChunk(const Defs::ChunkLocation& cl) const;
@@ -79,8 +137,19 @@ public:
 	inline const glm::vec3& ChunkOrigin3D() const { return m_ChunkOrigin; }
 	inline const glm::vec2 ChunkOrigin2D() const { return {m_ChunkOrigin.x, m_ChunkOrigin.z}; }
 	inline const glm::vec3& ChunkCenter() const { return m_ChunkCenter; }
+	inline glm::ivec2 ChunkCoords() const { return glm::ivec2(glm::floor(ChunkOrigin2D() / static_cast<f32>(s_ChunkWidthAndHeight))); }
 	inline glm::vec3 ToWorld(glm::u8vec3 pos) const { return m_ChunkOrigin + static_cast<glm::vec3>(pos); }
-	inline void PushDrop(const glm::vec3& position, Defs::Item type) { m_LocalDrops.emplace_back(position, type); }
+	//Raises the change kinds for the section holding y (or for every section), the kinds which were
+	//clean are published to the world once the chunk is registered
+	void MarkChanged(u8 kinds, s32 y);
+	void MarkAllChanged(u8 kinds);
+	inline bool HasChange(Changes::Kind kind) const { return m_Changes.Has(kind); }
+	inline bool ConsumeChange(Changes::Kind kind) { return m_Changes.Consume(kind); }
+	//Called when the chunk enters the world, publishes the changes raised while it was built
+	void StartPublishingChanges();
+	//Faces of a section connected to each face through empty cells, in normal index order:
+	//bit j of entry i is set if something entering from face i can leave from face j
+	inline const std::array<u8, 6>& SectionConnectivity(u32 section) const { return m_SectionConnectivity[section]; }
 
 	//Sum this with the chunk origin to get chunk's center
 	static glm::vec3 GetHalfWayVector();
@@ -89,27 +158,52 @@ public:
 	const Utils::Serializer& Serialize(const Utils::Serializer& sz);
 	const Utils::Serializer& Deserialize(const Utils::Serializer& sz);
 public:
-	//Variable used to determine which chunk holds the selected block
-	//used instead of Gd::g_SelectedChunk in multiple iterations so we
-	//access the atomic variable only once
-	static u32 s_InternalSelectedBlock;
 	u8 lower_threshold;
 
 	Utils::Vector<Block> chunk_blocks;
 
 private:
-	//Returns if there is a block at the location pos
-	//The last two attributes can be used to make the searching faster
-	bool IsBlock(const glm::vec3& pos, s32 starting_index = 0, bool search_towards_end = true, u32* block_index = nullptr) const;
-	Block& GetBlock(u32 index);
-	const Block& GetBlock(u32 index) const;
-
-	//Wrapper function that assigns normals to border blocks if there are no other blocks even in the confining chunk
-	bool BorderCheck(Chunk* chunk, const glm::vec3& pos, u32 top_index, u32 bot_index, bool search_dir);
+	//Updates the bit of a position in every border plane it belongs to
+	void SetBorderBit(const glm::ivec3& local_pos, bool solid);
+	//Marks in the border planes the positions which are still solid by generation
+	void InitImplicitBorderRows();
+	//Assigns the faces between this chunk and the adjacent one by comparing their facing border planes
+	void ExchangeBorderFaces(Chunk& side_chunk, const Defs::ChunkLocation& cl);
+	static u32 BorderPlaneIndex(const Defs::ChunkLocation& cl);
+	static glm::ivec3 BorderPosition(u32 plane, s32 y, s32 bit);
+	//Bit index of an underground position in m_MaterializedCells
+	static u32 UndergroundCellIndex(const glm::ivec3& local_pos);
+	//Position of a block inside its section's index array
+	static u32 SectionCellIndex(const glm::ivec3& local_pos);
+	void SetBlockIndex(const glm::ivec3& local_pos, u32 index);
+	//Adds or removes each face of the block depending on its neighbors
+	void ComputeBlockFaces(Block& block);
+	//Flood fills the empty cells of the section and records which of its faces they connect
+	void ComputeSectionConnectivity(u32 section);
+	//Sets or clears a position without any face work, returns false if nothing changed
+	bool WriteCell(const glm::ivec3& local_pos, std::optional<Defs::Item> type);
+	//Adjacent chunks in the PlusX, MinusX, PlusZ, MinusZ order, nullptr if not loaded
+	void SideChunks(Chunk* side_chunks[4]);
+	//Like ResolveNeighbor but using already resolved side chunks
+	Chunk* CrossBorder(glm::ivec3& local_pos, Chunk* const side_chunks[4]);
+	//Type given to underground blocks when they are materialized
+	Defs::Item ImplicitBlockType(const glm::ivec3& local_pos) const;
+	//Sets a face of one of this chunk's blocks, keeping track of the lowest exposed block of the column
+	void SetBlockFace(Block& block, u32 normal, bool exposed);
+	//Merges the water layers in m_WaterRects, must be called whenever they change
+	void BuildWaterRects();
+	//Forwards the newly raised kinds to the world once the chunk is registered
+	void PublishChanges(u8 raised_kinds);
+	//Lowers the column height until a solid position is found
+	void RefreshColumnHeight(s32 x, s32 z);
+	//Append the packed faces of a single direction to the instances
+	void AppendBlockFaces(Utils::Vector<u32>& instances, u32 face) const;
+	//Merges the coplanar faces with the same texture in quads of up to s_MaxQuadSize blocks per side
+	void AppendGreedyFaces(Utils::Vector<u32>& instances, u32 face) const;
 	//Converts from chunk space to real world space
 
 	//Creates a chunk hash according to its position
-	u64 Hash(glm::vec2 vec);
+	static u64 Hash(glm::vec2 vec);
 private:
 	//Global OpenGL environment state
 	GlCore::State& m_State;
@@ -119,9 +213,34 @@ private:
 	//Chunk progressive index
 	u32 m_ChunkIndex;
 
-	//Drops of brokeen blocks, the chunk which originated them is the
-	//responsible for updating and drawing them
-	Utils::Vector<Drop> m_LocalDrops;
+	//One bit for each position below lower_threshold, set when the position stops being
+	//solid by generation (materialized as a real block or carved out)
+	Utils::Vector<u64> m_MaterializedCells;
+	//Block lookup table, one entry for each vertical section of the chunk
+	std::array<ChunkSection, 16> m_Sections;
+	//Solidity of the four side faces (PlusX, MinusX, PlusZ, MinusZ), one row of 16 bits for each y.
+	//X planes are indexed by z and Z planes by x, so facing planes of adjacent chunks line up
+	std::array<std::array<u16, 256>, 4> m_BorderPlanes{};
+	//Per column data, indexed by x * 16 + z like the terrain generation
+	std::array<s16, 256> m_Heightmap{};
+	//Never raised when faces get hidden, so it stays a conservative bound for culling
+	std::array<s16, 256> m_LowestExposed{};
+	//What changed since each derived cache was last updated
+	Changes::Tracker m_Changes;
+	bool m_PublishChanges = false;
+	//Faces of the last build are sorted by direction, bucket i spans [m_FaceBuckets[i], m_FaceBuckets[i + 1])
+	std::array<u32, 7> m_FaceBuckets{};
+	//Lowest and highest y of the blocks with exposed faces, bounds the Y buckets
+	glm::ivec2 m_FaceHeightRange{};
+	//Same as above but extended by the water layers, empty (x > y) until the first build
+	glm::vec2 m_RenderHeightRange{ 1.0f, 0.0f };
+	//Used by the cave culling, recomputed by BuildInstances only for the sections whose solidity changed
+	std::array<std::array<u8, 6>, 16> m_SectionConnectivity{};
+	s32 m_SolidHeight = -1;
+	//Water surface merged in rectangles of equal height, packed like +Y block faces. Rebuilt only when the
+	//water layers change and sent once to the render thread, the first mesh update of a chunk always carries them
+	Utils::Vector<u32> m_WaterRects;
+	bool m_WaterChanged = true;
 
 	//Eventual water layer(using a shared ptr because this ptr will also be stored in world)
 	Utils::Vector<glm::vec3> m_WaterLayerPositions;
@@ -139,4 +258,12 @@ public:
 	static f32 s_DiagonalLenght;
 	static constexpr u32 s_ChunkWidthAndHeight = 16;
 	static constexpr u32 s_ChunkDepth = 110;
+	//Blocks can be placed up to the u8 limit of their local position
+	static constexpr u32 s_MaxHeight = 256;
+	static constexpr u32 s_SectionVolume = s_ChunkWidthAndHeight * s_ChunkWidthAndHeight * s_ChunkWidthAndHeight;
+	static constexpr u32 s_SectionCount = s_MaxHeight / s_ChunkWidthAndHeight;
+	//A full chunk holds s_SectionCount * s_SectionVolume blocks, which would already exhaust u16 indices
+	static constexpr u32 s_NoBlock = 0xFFFFFFFF;
+	//Quad sides are packed in 4 bits
+	static constexpr s32 s_MaxQuadSize = 16;
 };
\ No newline at end of file
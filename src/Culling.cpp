@@ -0,0 +1,347 @@
+#include "Culling.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined __SSE__ || defined _M_X64 || defined _M_AMD64
+#	define MC_CULLING_SSE
+#	include <xmmintrin.h>
+#endif
+
+namespace Culling
+{
+	Frustum ExtractFrustum(const glm::mat4& view_proj)
+	{
+		//Rows of the matrix, glm stores it by columns
+		glm::vec4 rows[4];
+		for (u32 i = 0; i < 4; i++)
+			rows[i] = glm::vec4(view_proj[0][i], view_proj[1][i], view_proj[2][i], view_proj[3][i]);
+
+		Frustum frustum;
+		frustum.planes[0] = rows[3] + rows[0]; //Left
+		frustum.planes[1] = rows[3] - rows[0]; //Right
+		frustum.planes[2] = rows[3] + rows[1]; //Bottom
+		frustum.planes[3] = rows[3] - rows[1]; //Top
+		frustum.planes[4] = rows[3] + rows[2]; //Near
+		frustum.planes[5] = rows[3] - rows[2]; //Far
+		return frustum;
+	}
+
+	void BoundsBatch::Clear()
+	{
+		min_x.clear(); min_y.clear(); min_z.clear();
+		max_x.clear(); max_y.clear(); max_z.clear();
+	}
+
+	void BoundsBatch::Push(const glm::vec3& min, const glm::vec3& max)
+	{
+		min_x.push_back(min.x); min_y.push_back(min.y); min_z.push_back(min.z);
+		max_x.push_back(max.x); max_y.push_back(max.y); max_z.push_back(max.z);
+	}
+
+	u32 BoundsBatch::Size() const
+	{
+		return static_cast<u32>(min_x.size());
+	}
+
+	void TestFrustum(const Frustum& frustum, const BoundsBatch& bounds, u8* visible)
+	{
+		//A box is outside if its farthest corner along a plane normal (p-vertex) is behind that plane
+		const u32 count = bounds.Size();
+		u32 i = 0;
+
+#ifdef MC_CULLING_SSE
+		for (; i + 4 <= count; i += 4)
+		{
+			const __m128 min_x = _mm_loadu_ps(bounds.min_x.data() + i);
+			const __m128 min_y = _mm_loadu_ps(bounds.min_y.data() + i);
+			const __m128 min_z = _mm_loadu_ps(bounds.min_z.data() + i);
+			const __m128 max_x = _mm_loadu_ps(bounds.max_x.data() + i);
+			const __m128 max_y = _mm_loadu_ps(bounds.max_y.data() + i);
+			const __m128 max_z = _mm_loadu_ps(bounds.max_z.data() + i);
+
+			__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps());
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				const __m128 px = plane.x > 0.0f ? max_x : min_x;
+				const __m128 py = plane.y > 0.0f ? max_y : min_y;
+				const __m128 pz = plane.z > 0.0f ? max_z : min_z;
+
+				__m128 distance = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(plane.x)), _mm_mul_ps(py, _mm_set1_ps(plane.y)));
+				distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(pz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+			}
+
+			const s32 mask = _mm_movemask_ps(inside);
+			for (u32 lane = 0; lane < 4; lane++)
+				visible[i + lane] = (mask >> lane) & 1;
+		}
+#endif
+
+		//Leftovers, or every box if SSE is not available
+		for (; i < count; i++)
+		{
+			visible[i] = 1;
+			for (const glm::vec4& plane : frustum.planes)
+			{
+				const glm::vec3 p(
+					plane.x > 0.0f ? bounds.max_x[i] : bounds.min_x[i],
+					plane.y > 0.0f ? bounds.max_y[i] : bounds.min_y[i],
+					plane.z > 0.0f ? bounds.max_z[i] : bounds.min_z[i]);
+
+				if (glm::dot(glm::vec3(plane), p) + plane.w < 0.0f)
+				{
+					visible[i] = 0;
+					break;
+				}
+			}
+		}
+	}
+
+	bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, f32 radius)
+	{
+		//The planes are not normalized, the radius is scaled instead
+		for (const glm::vec4& plane : frustum.planes)
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius * glm::length(glm::vec3(plane)))
+				return false;
+		return true;
+	}
+
+	static constexpr u32 LevelWidth(u32 level) { return std::max(OcclusionBuffer::s_Width >> level, 1u); }
+	static constexpr u32 LevelHeight(u32 level) { return std::max(OcclusionBuffer::s_Height >> level, 1u); }
+
+	static constexpr f32 s_Pi = 3.14159265f;
+
+	//Occluders closer than this are not rasterized
+	static constexpr f32 s_NearW = 0.1f;
+
+	OcclusionBuffer::OcclusionBuffer() :
+		m_ViewProj(1.0f), m_CameraPosition(0.0f)
+	{
+		static_assert((s_Width >> (s_LevelCount - 1)) == 1, "The last Hi-Z level must be a single texel wide");
+		for (u32 level = 0; level < s_LevelCount; level++)
+			m_Levels[level].resize(LevelWidth(level) * LevelHeight(level), 0.0f);
+	}
+
+	void OcclusionBuffer::Clear(const glm::mat4& view_proj, const glm::vec3& camera_position)
+	{
+		m_ViewProj = view_proj;
+		m_CameraPosition = camera_position;
+		std::fill(m_Levels[0].begin(), m_Levels[0].end(), 0.0f);
+	}
+
+	bool OcclusionBuffer::ProjectBox(const glm::vec3& min, const glm::vec3& max, std::array<glm::vec3, 8>& corners) const
+	{
+		for (u32 i = 0; i < 8; i++)
+		{
+			const glm::vec4 corner(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z, 1.0f);
+			const glm::vec4 clip = m_ViewProj * corner;
+			if (clip.w < s_NearW)
+				return false;
+
+			const f32 inv_w = 1.0f / clip.w;
+			corners[i] = glm::vec3(
+				(clip.x * inv_w * 0.5f + 0.5f) * s_Width,
+				(clip.y * inv_w * 0.5f + 0.5f) * s_Height,
+				inv_w);
+		}
+
+		return true;
+	}
+
+	void OcclusionBuffer::RasterizeBox(const glm::vec3& min, const glm::vec3& max)
+	{
+		std::array<glm::vec3, 8> corners;
+		if (!ProjectBox(min, max, corners))
+			return;
+
+		//Corners of each face (corner index bits are x, y, z), in normal index order
+		static constexpr u8 face_corners[6][4] = {
+			{ 1, 3, 7, 5 }, { 0, 4, 6, 2 },
+			{ 2, 6, 7, 3 }, { 0, 1, 5, 4 },
+			{ 4, 5, 7, 6 }, { 0, 2, 3, 1 },
+		};
+
+		for (u32 face = 0; face < 6; face++)
+		{
+			//Only the faces looking at the camera can be the nearest surface
+			const u32 axis = face / 2;
+			const bool facing = face % 2 == 0 ? m_CameraPosition[axis] > max[axis] : m_CameraPosition[axis] < min[axis];
+			if (!facing)
+				continue;
+
+			const u8* quad = face_corners[face];
+			RasterizeTriangle(corners[quad[0]], corners[quad[1]], corners[quad[2]]);
+			RasterizeTriangle(corners[quad[2]], corners[quad[3]], corners[quad[0]]);
+		}
+	}
+
+	void OcclusionBuffer::RasterizeTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2)
+	{
+		const f32 area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+		if (std::abs(area) < 1e-6f)
+			return;
+
+		const s32 min_x = std::max(static_cast<s32>(std::floor(std::min({ v0.x, v1.x, v2.x }))), 0);
+		const s32 max_x = std::min(static_cast<s32>(std::ceil(std::max({ v0.x, v1.x, v2.x }))), static_cast<s32>(s_Width) - 1);
+		const s32 min_y = std::max(static_cast<s32>(std::floor(std::min({ v0.y, v1.y, v2.y }))), 0);
+		const s32 max_y = std::min(static_cast<s32>(std::ceil(std::max({ v0.y, v1.y, v2.y }))), static_cast<s32>(s_Height) - 1);
+
+		//Edge functions evaluated at the pixel centers, normalized so that the inside is positive
+		//for both windings. Since 1/w is linear in screen space it is interpolated directly
+		const f32 inv_area = 1.0f / area;
+		Utils::Vector<f32>& depth = m_Levels[0];
+		for (s32 y = min_y; y <= max_y; y++)
+		{
+			const f32 py = static_cast<f32>(y) + 0.5f;
+			for (s32 x = min_x; x <= max_x; x++)
+			{
+				const f32 px = static_cast<f32>(x) + 0.5f;
+				const f32 w0 = ((v2.x - v1.x) * (py - v1.y) - (v2.y - v1.y) * (px - v1.x)) * inv_area;
+				const f32 w1 = ((v0.x - v2.x) * (py - v2.y) - (v0.y - v2.y) * (px - v2.x)) * inv_area;
+				const f32 w2 = 1.0f - w0 - w1;
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+
+				f32& texel = depth[y * s_Width + x];
+				texel = std::max(texel, w0 * v0.z + w1 * v1.z + w2 * v2.z);
+			}
+		}
+	}
+
+	void OcclusionBuffer::BuildHiZ()
+	{
+		//Each texel keeps the farthest (smallest) depth of the 2x2 texels below it
+		for (u32 level = 1; level < s_LevelCount; level++)
+		{
+			const Utils::Vector<f32>& below = m_Levels[level - 1];
+			Utils::Vector<f32>& current = m_Levels[level];
+			const u32 below_width = LevelWidth(level - 1), below_height = LevelHeight(level - 1);
+			const u32 width = LevelWidth(level), height = LevelHeight(level);
+
+			for (u32 y = 0; y < height; y++)
+			{
+				const u32 y0 = std::min(y * 2, below_height - 1), y1 = std::min(y * 2 + 1, below_height - 1);
+				for (u32 x = 0; x < width; x++)
+				{
+					const u32 x0 = std::min(x * 2, below_width - 1), x1 = std::min(x * 2 + 1, below_width - 1);
+					current[y * width + x] = std::min(
+						std::min(below[y0 * below_width + x0], below[y0 * below_width + x1]),
+						std::min(below[y1 * below_width + x0], below[y1 * below_width + x1]));
+				}
+			}
+		}
+	}
+
+	bool OcclusionBuffer::IsOccluded(const glm::vec3& min, const glm::vec3& max) const
+	{
+		std::array<glm::vec3, 8> corners;
+		if (!ProjectBox(min, max, corners))
+			return false;
+
+		glm::vec2 rect_min(corners[0]), rect_max(corners[0]);
+		f32 nearest = corners[0].z;
+		for (const glm::vec3& corner : corners)
+		{
+			rect_min = glm::min(rect_min, glm::vec2(corner));
+			rect_max = glm::max(rect_max, glm::vec2(corner));
+			nearest = std::max(nearest, corner.z);
+		}
+
+		if (rect_max.x < 0.0f || rect_max.y < 0.0f || rect_min.x >= s_Width || rect_min.y >= s_Height)
+			return false;
+
+		const s32 x0 = std::max(static_cast<s32>(std::floor(rect_min.x)), 0);
+		const s32 y0 = std::max(static_cast<s32>(std::floor(rect_min.y)), 0);
+		const s32 x1 = std::min(static_cast<s32>(std::floor(rect_max.x)), static_cast<s32>(s_Width) - 1);
+		const s32 y1 = std::min(static_cast<s32>(std::floor(rect_max.y)), static_cast<s32>(s_Height) - 1);
+
+		//Coarsest level where the rectangle spans at most 2x2 texels
+		u32 level = 0;
+		while (level + 1 < s_LevelCount && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+			level++;
+
+		const Utils::Vector<f32>& hiz = m_Levels[level];
+		const u32 width = LevelWidth(level), height = LevelHeight(level);
+		for (u32 y = y0 >> level; y <= std::min(static_cast<u32>(y1 >> level), height - 1); y++)
+			for (u32 x = x0 >> level; x <= std::min(static_cast<u32>(x1 >> level), width - 1); x++)
+				if (nearest >= hiz[y * width + x])
+					return false;
+
+		return true;
+	}
+
+	void HorizonBuffer::Clear(const glm::vec3& camera_position)
+	{
+		m_CameraPosition = camera_position;
+		m_Horizon.fill(std::numeric_limits<f32>::lowest());
+	}
+
+	bool HorizonBuffer::Footprint(const glm::vec3& min, const glm::vec3& max, f32& first_bin, f32& last_bin, f32& near_distance, f32& far_distance) const
+	{
+		const glm::vec2 camera(m_CameraPosition.x, m_CameraPosition.z);
+		const glm::vec2 rect_min(min.x, min.z), rect_max(max.x, max.z);
+		const glm::vec2 nearest = glm::clamp(camera, rect_min, rect_max);
+		near_distance = glm::distance(camera, nearest);
+		if (near_distance <= 0.0f)
+			return false;
+
+		//Corner angles relative to the center one, the footprint never spans half a turn when the camera is outside
+		const glm::vec2 center = (rect_min + rect_max) * 0.5f - camera;
+		const f32 center_angle = std::atan2(center.y, center.x);
+		f32 first_angle = 0.0f, last_angle = 0.0f;
+		far_distance = 0.0f;
+		for (u32 i = 0; i < 4; i++)
+		{
+			const glm::vec2 corner = glm::vec2(i & 1 ? rect_max.x : rect_min.x, i & 2 ? rect_max.y : rect_min.y) - camera;
+			far_distance = std::max(far_distance, glm::length(corner));
+
+			f32 angle = std::atan2(corner.y, corner.x) - center_angle;
+			if (angle > s_Pi)
+				angle -= 2.0f * s_Pi;
+			else if (angle < -s_Pi)
+				angle += 2.0f * s_Pi;
+			first_angle = std::min(first_angle, angle);
+			last_angle = std::max(last_angle, angle);
+		}
+
+		//Bins start at -pi, shifted by a whole turn so that the values stay positive
+		const f32 bins_per_radian = s_BinCount / (2.0f * s_Pi);
+		first_bin = (center_angle + first_angle + s_Pi) * bins_per_radian + s_BinCount;
+		last_bin = (center_angle + last_angle + s_Pi) * bins_per_radian + s_BinCount;
+		return true;
+	}
+
+	bool HorizonBuffer::IsBelowHorizon(const glm::vec3& min, const glm::vec3& max) const
+	{
+		f32 first_bin, last_bin, near_distance, far_distance;
+		if (!Footprint(min, max, first_bin, last_bin, near_distance, far_distance))
+			return false;
+
+		//Steepest slope any point of the box can be seen at
+		const f32 height = max.y - m_CameraPosition.y;
+		const f32 slope = height / (height > 0.0f ? near_distance : far_distance);
+		for (u32 bin = static_cast<u32>(first_bin); bin <= static_cast<u32>(last_bin); bin++)
+			if (slope >= m_Horizon[bin % s_BinCount])
+				return false;
+
+		return true;
+	}
+
+	void HorizonBuffer::AddOccluder(const glm::vec3& min, const glm::vec3& max, f32 solid_height)
+	{
+		f32 first_bin, last_bin, near_distance, far_distance;
+		if (!Footprint(min, max, first_bin, last_bin, near_distance, far_distance))
+			return;
+
+		//Every ray in the span crosses the footprint, the shallowest slope of its solid part is guaranteed.
+		//Only the bins entirely inside the span are raised
+		const f32 height = solid_height - m_CameraPosition.y;
+		const f32 slope = height / (height > 0.0f ? far_distance : near_distance);
+		for (u32 bin = static_cast<u32>(std::ceil(first_bin)); bin + 1 <= static_cast<u32>(last_bin); bin++)
+		{
+			f32& horizon = m_Horizon[bin % s_BinCount];
+			horizon = std::max(horizon, slope);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include "glm/glm.hpp"
+
+#include "Utils.h"
+
+//Visibility tests done on the CPU before chunks are forwarded to the renderer
+namespace Culling
+{
+	//Each plane is stored as (normal, distance), points with a negative signed distance are outside
+	struct Frustum
+	{
+		std::array<glm::vec4, 6> planes;
+	};
+
+	//Extracts the six clipping planes from a view projection matrix
+	Frustum ExtractFrustum(const glm::mat4& view_proj);
+
+	//Axis aligned boxes stored SoA, so that they can be tested four at a time
+	struct BoundsBatch
+	{
+		Utils::Vector<f32> min_x, min_y, min_z;
+		Utils::Vector<f32> max_x, max_y, max_z;
+
+		void Clear();
+		void Push(const glm::vec3& min, const glm::vec3& max);
+		u32 Size() const;
+	};
+
+	//Sets visible[i] to 1 if the i-th box intersects the frustum, 0 otherwise
+	void TestFrustum(const Frustum& frustum, const BoundsBatch& bounds, u8* visible);
+	//Conservative test of a single sphere, used for small objects which are not batched
+	bool IsSphereVisible(const Frustum& frustum, const glm::vec3& center, f32 radius);
+
+	//Low resolution software depth buffer. Occluder boxes are rasterized in it, then a Hi-Z pyramid
+	//storing the farthest depth of each texel lets boxes be tested against large screen areas at once.
+	//Depth is stored as 1/w, so bigger values are nearer and 0 is the empty background
+	class OcclusionBuffer
+	{
+	public:
+		static constexpr u32 s_Width = 256;
+		static constexpr u32 s_Height = 128;
+		static constexpr u32 s_LevelCount = 9;
+
+		OcclusionBuffer();
+
+		//Clears the depth buffer, the camera position is used to skip the box faces facing away
+		void Clear(const glm::mat4& view_proj, const glm::vec3& camera_position);
+		//The box is skipped if it crosses the near plane, occluders are never clipped
+		void RasterizeBox(const glm::vec3& min, const glm::vec3& max);
+		//Must be called after the occluders have been rasterized and before testing
+		void BuildHiZ();
+		//True if the box is entirely behind the rasterized occluders
+		bool IsOccluded(const glm::vec3& min, const glm::vec3& max) const;
+
+	private:
+		//Projects the 8 corners in (screen x, screen y, 1/w), false if one of them is behind the near plane
+		bool ProjectBox(const glm::vec3& min, const glm::vec3& max, std::array<glm::vec3, 8>& corners) const;
+		void RasterizeTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+		glm::mat4 m_ViewProj;
+		glm::vec3 m_CameraPosition;
+		//Level 0 is the depth buffer, each next level halves the resolution
+		std::array<Utils::Vector<f32>, s_LevelCount> m_Levels;
+	};
+
+	//1D buffer holding for each view azimuth the steepest slope (height over distance) of the terrain
+	//already processed. Filled front to back, a box whose top stays below it for its whole azimuth span is hidden
+	class HorizonBuffer
+	{
+	public:
+		static constexpr u32 s_BinCount = 1024;
+
+		void Clear(const glm::vec3& camera_position);
+		bool IsBelowHorizon(const glm::vec3& min, const glm::vec3& max) const;
+		//Raises the horizon behind a footprint which is solid up to solid_height
+		void AddOccluder(const glm::vec3& min, const glm::vec3& max, f32 solid_height);
+
+	private:
+		//Azimuth span in bin units (last_bin can exceed s_BinCount when wrapping) and the distance range
+		//of the XZ footprint. False if the camera is above the footprint
+		bool Footprint(const glm::vec3& min, const glm::vec3& max, f32& first_bin, f32& last_bin, f32& near_distance, f32& far_distance) const;
+
+		std::array<f32, s_BinCount> m_Horizon;
+		glm::vec3 m_CameraPosition;
+	};
+}
@@ -15,7 +15,6 @@ namespace Defs
     f32 g_PlayerSpeed = 0.0f;
 	const f32 g_ChunkSpawningDistance = 500.0f;
 	const f32 g_ChunkRenderingDistance = 300.0f;
-	const f32 g_CameraCompensation = 10.0f;
 	const f32 g_RenderDistance = 1500.0f;
     const f32 g_SectionDimension = 512.0f;
     u32 g_ChunkProgIndex = 0;
@@ -24,9 +23,7 @@ namespace Defs
 	const s32 g_SpawnerIncrement = 16;
     const glm::vec3 g_LightDirection{ 0.0f, -1.0f, 0.0f };
     std::atomic<u32> g_SelectedBlock{static_cast<u32>(-1)};
-    std::atomic<u32> g_SelectedChunk{static_cast<u32>(-1)};
     Defs::Item g_InventorySelectedBlock = Defs::Item::Dirt;
-    bool g_EnvironmentChange = false;
     //Shorthand for Sector SerialiZeD
     std::string g_SerializedFileFormat = ".sszd";
     std::unordered_set<u32> g_PushedSections;
@@ -487,6 +484,17 @@ namespace Defs
 }
 
 namespace Physics {
+    void ApplyCollision(const Collision& collision, Camera& camera)
+    {
+        camera.position += collision.correction;
+        for (u32 i = 0; i < 3; i++) {
+            if (collision.blocked_axes[i])
+                Defs::g_PlayerAxisMapping[i] = 0.0f;
+        }
+
+        if (collision.grounded.has_value())
+            Defs::jump_data = { 0.0f, collision.grounded.value() };
+    }
     void HandlePlayerMovement(f32 elapsed_time) 
     {
         Camera& camera = *GlCore::pstate->camera;
@@ -497,7 +505,6 @@ namespace Physics {
     {
         using Defs::jump_data;
         Camera& camera = *GlCore::pstate->camera;
-        //Read the value first, as that may be modified from the upload thread(WARNING, might be better to add a mutex)
         f32 clamped_y = Defs::g_PlayerAxisMapping.y;
 
         jump_data.first -= clamped_y * 50.0f * elapsed_time;
@@ -55,7 +55,8 @@ namespace Defs
 		TextureScreenInventorySelector,
 		TextureScreenFramebuffer,
 		TextureDepthFramebuffer,
-		TextureText
+		TextureText,
+		TextureChunkDrawData
 	};
 
 	struct WorldSeed
@@ -96,6 +97,33 @@ namespace Defs
 	};
 
 	enum class ChunkLocation { None = 0, PlusX, MinusX, PlusZ, MinusZ };
+	enum class EditShape : u8 { Box = 0, Sphere };
+	enum class EditOperation : u8 { Fill = 0, Replace, Clear };
+
+	//Description of a bulk edit in world coordinates
+	struct RegionEdit
+	{
+		EditShape shape;
+		EditOperation operation;
+		//Inclusive bounds, for spheres they enclose the whole sphere
+		glm::ivec3 min;
+		glm::ivec3 max;
+		glm::vec3 center;
+		f32 radius;
+		//Placed by Fill and Replace, replaced_type is only used by Replace
+		Item type;
+		Item replaced_type;
+
+		bool Contains(const glm::ivec3& pos) const
+		{
+			if (shape == EditShape::Box)
+				return pos.x >= min.x && pos.y >= min.y && pos.z >= min.z &&
+					pos.x <= max.x && pos.y <= max.y && pos.z <= max.z;
+
+			glm::vec3 diff = glm::vec3(pos) - center;
+			return glm::dot(diff, diff) <= radius * radius;
+		}
+	};
 	enum class Biome { Plains = 0, Desert };
 
 	//-----------------Variables
@@ -111,7 +139,6 @@ namespace Defs
 	extern f32 g_PlayerSpeed;
 	extern const f32 g_ChunkSpawningDistance;
 	extern const f32 g_ChunkRenderingDistance;
-	extern const f32 g_CameraCompensation;
 	extern const f32 g_RenderDistance;
 	extern const f32 g_SectionDimension;
 	//Personal index for each chunk
@@ -122,8 +149,6 @@ namespace Defs
 	extern const glm::vec3 g_LightDirection;
 	//Variables for block selection
 	extern std::atomic<u32> g_SelectedBlock;
-	extern std::atomic<u32> g_SelectedChunk;
-	extern bool g_EnvironmentChange;
 	//Inventory
 	static constexpr u8 g_InventoryInternalSlotsCount = 27;
 	static constexpr u8 g_InventoryScreenSlotsCount = 9;
@@ -177,6 +202,18 @@ namespace Defs
 }
 
 namespace Physics {
+	//Outcome of the collision probe of a logic update, only applied by the render thread
+	struct Collision
+	{
+		//Displacement moving the player out of the blocks it hit
+		glm::vec3 correction{ 0.0f };
+		//Axes of Defs::g_PlayerAxisMapping whose speed is reset by the hit
+		glm::bvec3 blocked_axes{ false };
+		//Set by a vertical hit: the jump stops, and can start again only when grounded
+		std::optional<bool> grounded;
+	};
+
+	void ApplyCollision(const Collision& collision, Camera& camera);
 	void HandlePlayerMovement(f32 elapsed_time);
 	void HandlePlayerGravity(f32 elapsed_time);
 	void ProcessPlayerAxisMovement(f32 elapsed_time);
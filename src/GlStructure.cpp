@@ -14,7 +14,8 @@ namespace GlCore
         Camera& cam = *state.camera;
         MeshStorage& stg = *state.mesh_storage;
         Memory::Arena* allocator = state.memory_arena;
-
+        state.state_cache = Memory::NewUnchecked<StateCache>(allocator);
+        state.matrix_block = Memory::NewUnchecked<MatrixBlock>(allocator);
 
         glm::vec3 spawn_coordinates(0.0f, 115.0f, 0.0f);
 
@@ -45,27 +46,19 @@ namespace GlCore
         state.crossaim_shader = Memory::NewUnchecked<Shader>(allocator, Utils::CompletePath("assets/shaders/basic_overlay.shader"));
         state.crossaim_shader->UniformMat4f(glm::scale(glm::mat4(1.0f), glm::vec3(0.01f)), "model");
 
-        //Load water stuff
-        elem = &stg.water_layer;
+        //Load water stuff, the merged water rectangles are packed like block faces
+        elem = &stg.face_quad;
         state.water_vm = Memory::NewUnchecked<VertexManager>(allocator, elem->data, elem->count * sizeof(f32), elem->lyt);
         state.water_shader = Memory::NewUnchecked<Shader>(allocator, Utils::CompletePath("assets/shaders/water.shader"));
-        state.water_shader->UniformMat4f(cam.GetProjMatrix(), "proj");
 
-        LayoutElement instanced_layout_element{ 3, GL_FLOAT, GL_FALSE, sizeof(f32) * 3, 0 };
-        state.water_vm->PushInstancedAttribute(nullptr, sizeof(glm::vec3) * g_MaxWaterLayersCount,
-            state.water_shader->GetAttributeLocation("model_pos"), instanced_layout_element);
+        state.stream_buffer = Memory::NewUnchecked<StreamBuffer>(allocator, g_StreamSegmentSize);
 
         //Init framebuffer
-        elem = &stg.pos_and_tex_coord_depth;
+        elem = &stg.face_quad;
         state.depth_vm = Memory::NewUnchecked<VertexManager>(allocator, elem->data, elem->count * sizeof(f32), elem->lyt);
         state.shadow_framebuffer = Memory::NewUnchecked<FrameBuffer>(allocator, g_DepthMapWidth, g_DepthMapHeight, FrameBufferType::DEPTH_ATTACHMENT);
         state.depth_shader = Memory::NewUnchecked<Shader>(allocator, Utils::CompletePath("assets/shaders/basic_shadow.shader"));
 
-        //Instanced attribute for block positions in the depth shader
-        instanced_layout_element = { 3, GL_FLOAT, GL_FALSE, sizeof(f32) * 3, 0 };
-        state.depth_vm->PushInstancedAttribute(nullptr, sizeof(glm::vec3) * g_MaxRenderedObjCount,
-        state.depth_shader->GetAttributeLocation("model_depth_pos"), instanced_layout_element);
-
         //Init inventory stuff
         elem = &stg.inventory;
         state.inventory_vm = Memory::NewUnchecked<VertexManager>(allocator, elem->data, elem->count * sizeof(f32), elem->lyt);
@@ -91,11 +84,23 @@ namespace GlCore
         state.screen_framebuffer = Memory::NewUnchecked<FrameBuffer>(allocator, Defs::g_ScreenWidth, Defs::g_ScreenHeight, FrameBufferType::COLOR_ATTACHMENT);
 
         //Load block and drop resources
-        elem = &stg.pos_and_tex_coord_default;
+        //Blocks are drawn one instance per visible face
+        elem = &stg.face_quad;
         state.block_vm = Memory::NewUnchecked<VertexManager>(allocator, elem->data, elem->count * sizeof(f32), elem->lyt);
         state.block_shader = Memory::NewUnchecked<Shader>(allocator, Utils::CompletePath("assets/shaders/scene.shader"));
+        elem = &stg.pos_and_tex_coord_default;
         state.drop_vm = Memory::NewUnchecked<VertexManager>(allocator, elem->data, elem->count * sizeof(f32), elem->lyt);
         state.drop_shader = Memory::NewUnchecked<Shader>(allocator, Utils::CompletePath("assets/shaders/basic_collectable.shader"));
+        //Drops in the world are drawn instanced from the stream buffer, the held item leaves the instance attributes unused.
+        //They point at the start of the buffer until the first drop draw
+        state.drop_vm->BindVertexArray();
+        glBindBuffer(GL_ARRAY_BUFFER, state.stream_buffer->Handle());
+        glEnableVertexAttribArray(g_DropTransformLocation);
+        glVertexAttribPointer(g_DropTransformLocation, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glVertexAttribDivisor(g_DropTransformLocation, 1);
+        glEnableVertexAttribArray(g_DropTypeLocation);
+        glVertexAttribPointer(g_DropTypeLocation, 1, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glVertexAttribDivisor(g_DropTypeLocation, 1);
 
         //Load textures
         InitGameTextures(state.game_textures);
@@ -104,14 +109,23 @@ namespace GlCore
         state.block_shader->Uniform1i(global_texture_index, "global_texture");
         state.drop_shader->Uniform1i(global_texture_index, "global_texture");
 
-        //Create instance buffer for positions and texindices
-        instanced_layout_element = { 3, GL_FLOAT, GL_FALSE, sizeof(f32) * 3, 0 };
-        state.block_vm->PushInstancedAttribute(nullptr, sizeof(glm::vec3) * g_MaxRenderedObjCount,
-            state.block_shader->GetAttributeLocation("model_pos"), instanced_layout_element);
-
-        instanced_layout_element = { 1, GL_UNSIGNED_INT, GL_FALSE, sizeof(u32), 0 };
-        state.block_vm->PushInstancedAttribute(nullptr, sizeof(u32) * g_MaxRenderedObjCount,
-            state.block_shader->GetAttributeLocation("tex_index"), instanced_layout_element);
+        //The packed block faces (see PackBlockInstance) of every chunk are stored in a single pool,
+        //both the block and the depth pass read their instances from it
+        state.block_pool = Memory::NewUnchecked<InstancePool>(allocator, g_InstancePoolCapacity);
+        state.block_pool->AttachTo(*state.block_vm);
+        state.block_pool->AttachTo(*state.depth_vm);
+        state.block_pool->AttachTo(*state.water_vm);
+        state.block_draws = Memory::NewUnchecked<BlockDrawBatch>(allocator);
+        const u32 draw_data_index = static_cast<u32>(Defs::TextureBinding::TextureChunkDrawData);
+        state.block_shader->Uniform1i(draw_data_index, "draw_data");
+        state.depth_shader->Uniform1i(draw_data_index, "draw_data");
+        state.water_shader->Uniform1i(draw_data_index, "draw_data");
+        state.water_shader->Uniform1i(global_texture_index, "global_texture");
+        state.block_shader->UniformVec2f(glm::vec2(ShadowTiles::s_Extent), "shadow_extent");
+        //Camera and light matrices are shared through a single uniform buffer
+        state.matrix_block->Attach(state.block_shader);
+        state.matrix_block->Attach(state.water_shader);
+        state.matrix_block->Attach(state.drop_shader);
 
         TextureOffsets global_texture_offsets = LoadGlobalTextureOffsets();
         auto& offsets = global_texture_offsets.offsets;
@@ -142,10 +156,12 @@ namespace GlCore
         Camera& camera = *pstate->camera;
         bool is_block = Defs::IsBlock(sprite);
 
-        state.drop_shader->Use();
-        state.drop_shader->Uniform1i(static_cast<u32>(sprite), "drop_texture_index");
+        StateCache& cache = *state.state_cache;
+        cache.UseProgram(state.drop_shader);
+        cache.Uniform1i(state.drop_shader, 0, CachedUniform::Instanced);
+        cache.Uniform1i(state.drop_shader, static_cast<u32>(sprite), CachedUniform::DropTextureIndex);
         const VertexManager* cur = is_block ? state.drop_vm : state.decal2d_vm;
-        cur->BindVertexArray();
+        cache.BindVertexArray(*cur);
 
         //Rotate the block selected to the bottom-right section of the player view
         f32 theta = Utils::PerspectiveItemRotation(g_FovDegrees, is_block);
@@ -162,7 +178,7 @@ namespace GlCore
         position_mat = glm::rotate(position_mat, -camera.RotationX() + extra_rotation, glm::vec3(0.0f, 1.0f, 0.0f));
 
         position_mat = glm::scale(position_mat, glm::vec3(0.5f));
-        state.drop_shader->UniformMat4f(position_mat, "model");
+        cache.UniformMat4f(state.drop_shader, position_mat, CachedUniform::Model);
 
         glDrawArrays(GL_TRIANGLES, 0, cur->GetIndicesCount());
     }
@@ -172,31 +188,9 @@ namespace GlCore
         Renderer::Render(pstate->crossaim_shader, *pstate->crossaim_vm, nullptr, {});
     }
 
-    void UpdateShadowFramebuffer()
-    {
-        auto& pos = pstate->camera->GetPosition();
-        f32 x = pos.x - std::fmod(pos.x, 32.0f);
-        f32 z = pos.z - std::fmod(pos.z, 32.0f);
-        glm::vec3 light_eye = glm::vec3(x, 600.0f, z);
-
-        static glm::mat4 proj = glm::ortho(-80.0f, 80.0f, -80.0f, 80.0f, 0.1f, 650.0f);
-        glm::mat4 view = glm::lookAt(light_eye, glm::vec3(light_eye.x, 0.0f, light_eye.z), glm::vec3(0.0f, 0.0f, 1.0f));
-        g_DepthSpaceMatrix = proj * view;
-
-        pstate->depth_shader->UniformMat4f(g_DepthSpaceMatrix, "lightSpace");
-    }
-
-    void UniformProjMatrix()
-    {
-        pstate->block_shader->UniformMat4f(pstate->camera->GetProjMatrix(), "proj");
-        pstate->drop_shader->UniformMat4f(pstate->camera->GetProjMatrix(), "proj");
-    }
-
-    void UniformViewMatrix()
+    void UpdateShadowFramebuffer(const glm::mat4& light_space)
     {
-        pstate->block_shader->UniformMat4f(pstate->camera->GetViewMatrix(), "view");
-        pstate->drop_shader->UniformMat4f(pstate->camera->GetViewMatrix(), "view");
-        pstate->water_shader->UniformMat4f(pstate->camera->GetViewMatrix(), "view");
+        pstate->state_cache->UniformMat4f(pstate->depth_shader, light_space, CachedUniform::LightSpace);
     }
 
     void InitGameTextures(std::vector<Texture>& textures)
@@ -19,9 +19,8 @@ namespace GlCore
     //Renders the items that is held by the player
     void RenderHeldItem(Defs::Item sprite);
     void RenderCrossaim();
-    void UpdateShadowFramebuffer();
+    //Sets the light space used by the depth pass
+    void UpdateShadowFramebuffer(const glm::mat4& light_space);
 
-    void UniformProjMatrix();
-    void UniformViewMatrix();
     void InitGameTextures(std::vector<Texture>& textures);
 }
\ No newline at end of file
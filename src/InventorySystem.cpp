@@ -218,8 +218,8 @@ void Inventory::InternalRender()
     //Actual inventory rendering
     Defs::TextureBinding texture = view_crafting_table ? Defs::TextureBinding::TextureCraftingTableInventory : Defs::TextureBinding::TextureInventory;
     u32 inventory_binding = static_cast<u32>(texture);
-    m_State.game_textures[inventory_binding].Bind(inventory_binding);
-    m_State.inventory_shader->Uniform1i(inventory_binding, "texture_inventory");
+    m_State.state_cache->BindTexture(inventory_binding, m_State.game_textures[inventory_binding]);
+    m_State.state_cache->Uniform1i(m_State.inventory_shader, inventory_binding, GlCore::CachedUniform::TextureInventory);
     GlCore::Renderer::Render(m_State.inventory_shader, *m_State.inventory_vm, nullptr, m_InternAbsTransf);
 
     //Draw entries
@@ -268,8 +268,8 @@ void Inventory::ScreenRender()
     
 
     u32 scr_inventory_binding = static_cast<u32>(Defs::TextureBinding::TextureScreenInventory);
-    m_State.game_textures[scr_inventory_binding].Bind(scr_inventory_binding);
-    m_State.inventory_shader->Uniform1i(scr_inventory_binding, "texture_inventory");
+    m_State.state_cache->BindTexture(scr_inventory_binding, m_State.game_textures[scr_inventory_binding]);
+    m_State.state_cache->Uniform1i(m_State.inventory_shader, scr_inventory_binding, GlCore::CachedUniform::TextureInventory);
     GlCore::Renderer::Render(m_State.inventory_shader, *m_State.inventory_vm, nullptr, m_ScreenAbsTransf);
 
     //Draw entities
@@ -283,8 +283,8 @@ void Inventory::ScreenRender()
 
     //Render selector
     u32 selector_binding = static_cast<u32>(Defs::TextureBinding::TextureScreenInventorySelector);
-    m_State.game_textures[selector_binding].Bind(selector_binding);
-    m_State.inventory_shader->Uniform1i(selector_binding, "texture_inventory");
+    m_State.state_cache->BindTexture(selector_binding, m_State.game_textures[selector_binding]);
+    m_State.state_cache->Uniform1i(m_State.inventory_shader, selector_binding, GlCore::CachedUniform::TextureInventory);
     auto [screen_slot_transform, _] = SlotScreenTransform(m_CursorIndex, true);
     GlCore::Renderer::Render(m_State.inventory_shader, *m_State.inventory_vm, nullptr, screen_slot_transform);
 }
@@ -298,14 +298,16 @@ void Inventory::RenderEntry(EntryType entry_type, InventoryEntry entry, u32 bind
         glEnable(GL_BLEND);
         m_TextRenderer.DrawString(std::to_string(entry.item_count), num_transform);
         glDisable(GL_BLEND);
+        //The text renderer binds its own program and vertex array
+        m_State.state_cache->InvalidateBindings();
 
         //Reset the optional index uniform
-        m_State.inventory_shader->Uniform1i(-1, "optional_texture_index");
+        m_State.state_cache->Uniform1i(m_State.inventory_shader, -1, GlCore::CachedUniform::OptionalTextureIndex);
     };
 
     //Drawing actual block
-    m_State.inventory_shader->Uniform1i(static_cast<s32>(Defs::TextureBinding::GlobalTexture), "texture_inventory");
-    m_State.inventory_shader->Uniform1i(static_cast<s32>(entry.item_type), "optional_texture_index");
+    m_State.state_cache->Uniform1i(m_State.inventory_shader, static_cast<s32>(Defs::TextureBinding::GlobalTexture), GlCore::CachedUniform::TextureInventory);
+    m_State.state_cache->Uniform1i(m_State.inventory_shader, static_cast<s32>(entry.item_type), GlCore::CachedUniform::OptionalTextureIndex);
     switch (entry_type) {
     case EntryType::Default: {
             auto [icon_transform, num_transform] = SlotTransform(binding_index, entry.item_count >= 10);
@@ -343,8 +345,9 @@ void Inventory::RenderEntry(EntryType entry_type, InventoryEntry entry, u32 bind
             glm::ivec2 number_padding(2, 2);
             m_TextRenderer.DrawString(std::to_string(entry.item_count), glm::ivec2(dx + factor, dy) + number_padding);
             glDisable(GL_BLEND);
+            m_State.state_cache->InvalidateBindings();
 
-            m_State.inventory_shader->Uniform1i(-1, "optional_texture_index");
+            m_State.state_cache->Uniform1i(m_State.inventory_shader, -1, GlCore::CachedUniform::OptionalTextureIndex);
         } return;
     }
 }
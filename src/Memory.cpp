@@ -34,6 +34,7 @@ namespace Memory
 
 	VAddr Allocate(Arena* arena, u64 size)
 	{
+		std::lock_guard<std::mutex> lock{ arena->allocation_mutex };
 		u64 required_bytes = size + padding;
 		MC_ASSERT(arena->mapped_space.memory_used + required_bytes < arena->mapped_space.memory_size, "there is no more space in the memory arena");
 		auto& mapped_regions = arena->mapped_space.mapped_regions;
@@ -66,6 +67,7 @@ namespace Memory
 
 	void Free(Arena* arena, VAddr addr)
 	{
+		std::lock_guard<std::mutex> lock{ arena->allocation_mutex };
 		auto& mapped_regions = arena->mapped_space.mapped_regions;
 		auto iter = mapped_regions.find(addr);
 #ifdef _DEBUG
@@ -84,6 +86,7 @@ namespace Memory
 
 	void* AllocateUnchecked(Arena* arena, u64 size)
 	{
+		std::lock_guard<std::mutex> lock{ arena->allocation_mutex };
 		MC_ASSERT(arena->mapped_space.memory_used + size < arena->mapped_space.memory_size, "there is no more space in the memory arena");
 		auto& mapped_regions = arena->mapped_space.mapped_regions;
 
@@ -111,6 +114,7 @@ namespace Memory
 
 	void FreeUnchecked(Arena* arena, void* ptr)
 	{
+		std::lock_guard<std::mutex> lock{ arena->allocation_mutex };
 		auto& mapped_regions = arena->mapped_space.mapped_regions;
 		VAddr addr = static_cast<VAddr>(static_cast<u8*>(ptr) - static_cast<u8*>(arena->mapped_space.memory));
 
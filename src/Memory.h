@@ -64,6 +64,8 @@ namespace Memory
 		bool initialized;
 		std::mutex arena_mutex;
 		std::condition_variable arena_condition_variable;
+		//Guards mapped_regions, containers can be resized by multiple threads at once
+		std::mutex allocation_mutex;
 
 		//Variable which tracks how much allocated memory won't be explicitly freed by
 		//destructors or some other equivalent methods. This is used to track small buffers
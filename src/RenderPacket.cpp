@@ -0,0 +1,103 @@
+#include "RenderPacket.h"
+#include "Chunk.h"
+
+bool ChunkRenderRecord::IsRenderable(const glm::vec3& camera_position) const
+{
+	const glm::vec2 offset = glm::vec2(camera_position.x, camera_position.z) - center;
+	return glm::dot(offset, offset) < Defs::g_ChunkRenderingDistance * Defs::g_ChunkRenderingDistance;
+}
+
+void RenderPacket::Clear()
+{
+	chunks.clear();
+	occluders.Clear();
+}
+
+bool ChunkMesh::Apply(const ChunkMeshUpdate& update)
+{
+	GlCore::InstancePool& pool = *GlCore::pstate->block_pool;
+	if (!pool.Upload(m_InstanceRange, update.instances.data(), static_cast<u32>(update.instances.size())))
+		return false;
+	m_FaceBuckets = update.face_buckets;
+	m_FaceHeightRange = update.face_height_range;
+
+	//The water rectangles stay in the pool until they are rebuilt
+	if (update.water_changed)
+		return pool.Upload(m_WaterRange, update.water_rects.data(), static_cast<u32>(update.water_rects.size()));
+	return true;
+}
+
+void ChunkMesh::Free()
+{
+	GlCore::InstancePool& pool = *GlCore::pstate->block_pool;
+	pool.Free(m_InstanceRange);
+	pool.Free(m_WaterRange);
+}
+
+u32 ChunkMesh::RenderFaces(const ChunkRenderRecord& record, const glm::vec3& camera_position, bool depth_buf_draw) const
+{
+	if (m_InstanceRange.count == 0)
+		return 0;
+
+	if (depth_buf_draw)
+	{
+		//The light looks straight down, so the nearest surface is always a top face
+		static constexpr u32 top_face = 2;
+		const u32 count = m_FaceBuckets[top_face + 1] - m_FaceBuckets[top_face];
+		if (count > 0)
+			GlCore::DispatchDepthRendering(m_InstanceRange, m_FaceBuckets[top_face], count, record.origin);
+		return count;
+	}
+
+	//Buckets are contiguous in the pool range, so consecutive visible ones are drawn together
+	const u8 visible = VisibleFaceBuckets(record.origin, camera_position);
+	u32 drawn_count = 0;
+	u32 face = 0;
+	while (face < 6)
+	{
+		if (!(visible & (1 << face))) {
+			face++;
+			continue;
+		}
+
+		const u32 first = m_FaceBuckets[face];
+		while (face < 6 && (visible & (1 << face)))
+			face++;
+
+		const u32 count = m_FaceBuckets[face] - first;
+		if (count > 0)
+			GlCore::DispatchBlockRendering(m_InstanceRange, first, count, record.origin, record.selected_block);
+		drawn_count += count;
+	}
+
+	return drawn_count;
+}
+
+u32 ChunkMesh::RenderWater(const ChunkRenderRecord& record) const
+{
+	if (m_WaterRange.count == 0)
+		return 0;
+
+	GlCore::DispatchWaterRendering(m_WaterRange, record.origin);
+	return m_WaterRange.count;
+}
+
+u8 ChunkMesh::VisibleFaceBuckets(const glm::vec2& origin, const glm::vec3& camera_position) const
+{
+	//A bucket can be seen only if the camera is in front of the outermost plane its faces can lie on
+	//(faces are half a block away from the block centers)
+	constexpr f32 side = static_cast<f32>(Chunk::s_ChunkWidthAndHeight);
+	const glm::vec3 min_plane = glm::vec3(origin.x + 0.5f, static_cast<f32>(m_FaceHeightRange.x) + 0.5f, origin.y + 0.5f);
+	const glm::vec3 max_plane = glm::vec3(origin.x + side - 1.5f, static_cast<f32>(m_FaceHeightRange.y) - 0.5f, origin.y + side - 1.5f);
+
+	u8 mask = 0;
+	for (u32 axis = 0; axis < 3; axis++)
+	{
+		if (camera_position[axis] > min_plane[axis])
+			mask |= 1 << (axis * 2);
+		if (camera_position[axis] < max_plane[axis])
+			mask |= 1 << (axis * 2 + 1);
+	}
+
+	return mask;
+}
@@ -0,0 +1,142 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include "glm/glm.hpp"
+
+#include "Utils.h"
+#include "Renderer.h"
+#include "Culling.h"
+
+//Data handed from the logic thread to the render thread. The render thread draws only from these copies,
+//chunk objects are read and edited by the logic and serialization threads alone
+
+//Faces of a chunk built by the logic thread, applied by the render thread in recording order
+struct ChunkMeshUpdate
+{
+	//Sequence of the first packet which can draw the new mesh
+	u64 sequence = 0;
+	glm::ivec2 chunk_coords{ 0 };
+	glm::vec2 chunk_origin{ 0.0f };
+	//The chunk left the world, its pool ranges are freed
+	bool release = false;
+	//The shadow map tiles over the chunk have to be rendered again
+	bool shadow_changed = false;
+	//The merged water rectangles are sent only when they change
+	bool water_changed = false;
+	//Packed faces sorted by direction, bucket i spans [face_buckets[i], face_buckets[i + 1])
+	Utils::Vector<u32> instances;
+	std::array<u32, 7> face_buckets{};
+	glm::ivec2 face_height_range{ 0 };
+	Utils::Vector<u32> water_rects;
+};
+
+//What the culling and the draws need from a chunk, copied when the packet is recorded
+struct ChunkRenderRecord
+{
+	glm::ivec2 chunk_coords;
+	glm::vec2 origin;
+	glm::vec2 center;
+	glm::vec3 bounds_min;
+	glm::vec3 bounds_max;
+	s32 solid_height;
+	//Packed position of the selected block, -1 if the chunk does not hold it
+	s32 selected_block;
+	//Occluder boxes of the chunk in the packet, none for the chunks far from the camera
+	u32 first_occluder;
+	u32 occluder_count;
+	std::array<std::array<u8, 6>, 16> connectivity;
+
+	//Same test of Chunk::IsChunkRenderable
+	bool IsRenderable(const glm::vec3& camera_position) const;
+};
+
+//Immutable result of a logic update: the chunks around the camera which have something to draw
+struct RenderPacket
+{
+	u64 sequence = 0;
+	//Camera of the logic update, the chunks were gathered around it
+	glm::vec3 camera_position{ 0.0f };
+	//Collision of the player at camera_position with the blocks around it
+	Physics::Collision collision;
+	Utils::Vector<ChunkRenderRecord> chunks;
+	Culling::BoundsBatch occluders;
+
+	void Clear();
+};
+
+//Pool ranges of a chunk, owned by the render thread and rewritten by the chunk's mesh updates
+class ChunkMesh
+{
+public:
+	//Returns false if the pool is full, the update has to be applied again later
+	bool Apply(const ChunkMeshUpdate& update);
+	void Free();
+	//Queues the faces in the current pass, skipping the directions facing away from the camera.
+	//Returns how many quads were queued
+	u32 RenderFaces(const ChunkRenderRecord& record, const glm::vec3& camera_position, bool depth_buf_draw) const;
+	//Queues the water rectangles in the current pass, returns how many were queued
+	u32 RenderWater(const ChunkRenderRecord& record) const;
+
+private:
+	//Bit mask of the face directions (normal index order) which can be seen from the camera position
+	u8 VisibleFaceBuckets(const glm::vec2& origin, const glm::vec3& camera_position) const;
+
+	GlCore::PoolRange m_InstanceRange;
+	std::array<u32, 7> m_FaceBuckets{};
+	glm::ivec2 m_FaceHeightRange{ 0 };
+	GlCore::PoolRange m_WaterRange;
+};
+
+//Lock-free triple buffer: the writer fills its slot and swaps it with the shared one, the reader
+//swaps the shared slot with its own when a newer one was published. Neither side ever waits
+template<class T>
+class TripleBuffer
+{
+public:
+	//Slot owned by the writer, the reader never sees it until Publish
+	T& WriteSlot();
+	void Publish();
+	//Takes the last published slot, returns false if nothing newer was published
+	bool Acquire();
+	//Slot owned by the reader, stays unchanged until the next Acquire
+	const T& ReadSlot() const;
+
+private:
+	//Set in the shared index when it holds a slot the reader did not take yet
+	static constexpr u8 s_FreshBit = 4;
+	static constexpr u8 s_IndexMask = 3;
+
+	std::array<T, 3> m_Slots;
+	u8 m_WriteIndex = 0;
+	u8 m_ReadIndex = 1;
+	std::atomic<u8> m_Shared = 2;
+};
+
+template<class T>
+T& TripleBuffer<T>::WriteSlot()
+{
+	return m_Slots[m_WriteIndex];
+}
+
+template<class T>
+void TripleBuffer<T>::Publish()
+{
+	//Release the written slot, acquire the one the reader left behind
+	m_WriteIndex = m_Shared.exchange(m_WriteIndex | s_FreshBit, std::memory_order_acq_rel) & s_IndexMask;
+}
+
+template<class T>
+bool TripleBuffer<T>::Acquire()
+{
+	if (!(m_Shared.load(std::memory_order_relaxed) & s_FreshBit))
+		return false;
+
+	m_ReadIndex = m_Shared.exchange(m_ReadIndex, std::memory_order_acq_rel) & s_IndexMask;
+	return true;
+}
+
+template<class T>
+const T& TripleBuffer<T>::ReadSlot() const
+{
+	return m_Slots[m_ReadIndex];
+}
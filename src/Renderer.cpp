@@ -1,4 +1,6 @@
 #include <chrono>
+#include <cstring>
+#include <limits>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Renderer.h"
@@ -10,6 +12,12 @@ namespace GlCore
 {
 	std::atomic_bool g_LogicThreadShouldRun = true;
 	std::atomic_bool g_SerializationRunning = false;
+	std::atomic_bool g_GreedyMeshing = false;
+	std::atomic_bool g_MultiDrawIndirect = true;
+	std::atomic_bool g_OcclusionCulling = true;
+	std::atomic_bool g_CaveCulling = true;
+	std::atomic_bool g_HorizonCulling = true;
+	std::atomic_bool g_DepthPrepass = false;
 
 	glm::vec3 g_FramebufferPlayerOffset = glm::vec3(0.0f, 50.0f, 0.0f);
 	glm::mat4 g_DepthSpaceMatrix(1.0f);
@@ -45,56 +53,676 @@ namespace GlCore
 
 	void Renderer::IRender(Shader* shd, const VertexManager& vm, CubeMap* cubemap, const glm::mat4& model)
 	{
-		shd->Use();
-		vm.BindVertexArray();
+		StateCache& cache = *pstate->state_cache;
+		cache.UseProgram(shd);
+		cache.BindVertexArray(vm);
 
 		if (cubemap)
 		{
 			cubemap->BindTexture();
-			shd->Uniform1i(0, "skybox");
+			cache.Uniform1i(shd, 0, CachedUniform::Skybox);
 		}
 
-		//If we uniform something the shader gets bound automatically
 		if (model != g_NullMatrix)
 		{
-			shd->UniformMat4f(model, "model");
+			cache.UniformMat4f(shd, model, CachedUniform::Model);
 		}
 		glDrawArrays(GL_TRIANGLES, 0, vm.GetIndicesCount());
 	}
 	void Renderer::IRenderInstanced(u32 count)
 	{
-		//This function is used only to draw block meshes in this application
-		//so leave the static interval (0, 36)
-		glDrawArraysInstanced(GL_TRIANGLES, 0, 36, count);
+		//Every instanced mesh in this application is a single quad (block faces and
+		//water layers), so leave the static interval (0, 6)
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+	}
+
+	InstancePool::InstancePool(u32 capacity)
+	{
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(u32), nullptr, GL_DYNAMIC_DRAW);
+		m_FreeRanges[0] = capacity;
+	}
+
+	InstancePool::~InstancePool()
+	{
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	void InstancePool::AttachTo(const VertexManager& vm)
+	{
+		vm.BindVertexArray();
+		glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+		glEnableVertexAttribArray(g_InstanceAttributeLocation);
+		glVertexAttribIPointer(g_InstanceAttributeLocation, 1, GL_UNSIGNED_INT, sizeof(u32), nullptr);
+		glVertexAttribDivisor(g_InstanceAttributeLocation, 1);
+	}
+
+	bool InstancePool::Upload(PoolRange& range, const u32* instances, u32 count)
+	{
+		if (count > range.capacity)
+		{
+			//Leave some room so that a few placed blocks do not move the range again
+			u32 capacity = (count + count / 4 + 63) & ~63u;
+			std::optional<u32> offset;
+			{
+				std::scoped_lock lk(m_Mutex);
+				offset = AllocateRange(capacity);
+			}
+
+			//The old range is kept, so that the previous faces are still drawn until a retry fits
+			if (!offset.has_value())
+				return false;
+
+			Free(range);
+			range.offset = offset.value();
+			range.capacity = capacity;
+		}
+
+		range.count = count;
+		if (count > 0)
+		{
+			//Staged in the stream buffer, the copy is then ordered on the GPU after the draws
+			//still reading the old faces instead of stalling the CPU
+			StreamBuffer& stream = *pstate->stream_buffer;
+			const u32 size = count * sizeof(u32);
+			std::memcpy(stream.Reserve(size), instances, size);
+			const u32 source_offset = stream.Commit();
+
+			glBindBuffer(GL_COPY_READ_BUFFER, stream.Handle());
+			glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, source_offset, range.offset * sizeof(u32), size);
+		}
+
+		return true;
+	}
+
+	void InstancePool::Free(PoolRange& range)
+	{
+		if (range.capacity > 0)
+		{
+			std::scoped_lock lk(m_Mutex);
+			FreeRange(range.offset, range.capacity);
+		}
+
+		range = {};
+	}
+
+	void InstancePool::BindInstances(u32 first_instance)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+		glVertexAttribIPointer(g_InstanceAttributeLocation, 1, GL_UNSIGNED_INT, sizeof(u32),
+			reinterpret_cast<const void*>(static_cast<uintptr_t>(first_instance) * sizeof(u32)));
+	}
+
+	std::optional<u32> InstancePool::AllocateRange(u32 capacity)
+	{
+		//First fit
+		for (auto iter = m_FreeRanges.begin(); iter != m_FreeRanges.end(); ++iter)
+		{
+			auto [offset, size] = *iter;
+			if (size < capacity)
+				continue;
+
+			m_FreeRanges.erase(iter);
+			if (size > capacity)
+				m_FreeRanges[offset + capacity] = size - capacity;
+
+			return offset;
+		}
+
+		return std::nullopt;
+	}
+
+	void InstancePool::FreeRange(u32 offset, u32 capacity)
+	{
+		auto next = m_FreeRanges.lower_bound(offset);
+		//Merge with the following free range
+		if (next != m_FreeRanges.end() && offset + capacity == next->first)
+		{
+			capacity += next->second;
+			next = m_FreeRanges.erase(next);
+		}
+
+		//Merge with the previous free range
+		if (next != m_FreeRanges.begin())
+		{
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset)
+			{
+				prev->second += capacity;
+				return;
+			}
+		}
+
+		m_FreeRanges[offset] = capacity;
+	}
+
+	StreamBuffer::StreamBuffer(u32 segment_size)
+	{
+		m_Persistent = GLEW_ARB_buffer_storage;
+		Create(segment_size);
+	}
+
+	StreamBuffer::~StreamBuffer()
+	{
+		Destroy();
+	}
+
+	void StreamBuffer::BeginFrame()
+	{
+		WaitSegment(m_Segment);
+		m_Head = 0;
+	}
+
+	void StreamBuffer::EndFrame()
+	{
+		m_Fences[m_Segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_Segment = (m_Segment + 1) % g_StreamFrameCount;
+	}
+
+	void* StreamBuffer::Reserve(u32 size)
+	{
+		//Keep the offsets aligned for every attribute type
+		size = (size + 15) & ~15u;
+		if (m_Head + size > m_SegmentSize)
+		{
+			//Grow instead of wrapping over data the GPU may still read. The data committed in this frame
+			//has already been consumed by the commands which used it, so the old buffer can be dropped
+			for (u32 i = 0; i < g_StreamFrameCount; i++)
+				WaitSegment(i);
+
+			Destroy();
+			Create(std::max(m_SegmentSize * 2, size));
+			m_Head = 0;
+		}
+
+		m_ReservedSize = size;
+		const u32 offset = m_Segment * m_SegmentSize + m_Head;
+		return m_Persistent ? m_Mapped + offset : m_Staging.data() + offset;
+	}
+
+	u32 StreamBuffer::Commit()
+	{
+		const u32 offset = m_Segment * m_SegmentSize + m_Head;
+		if (!m_Persistent)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+			glBufferSubData(GL_ARRAY_BUFFER, offset, m_ReservedSize, m_Staging.data() + offset);
+		}
+
+		m_Head += m_ReservedSize;
+		m_ReservedSize = 0;
+		return offset;
+	}
+
+	u32 StreamBuffer::Handle() const
+	{
+		return m_Buffer;
+	}
+
+	void StreamBuffer::Create(u32 segment_size)
+	{
+		m_SegmentSize = (segment_size + 15) & ~15u;
+		const u32 total_size = m_SegmentSize * g_StreamFrameCount;
+
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+		if (m_Persistent)
+		{
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_ARRAY_BUFFER, total_size, nullptr, flags);
+			m_Mapped = static_cast<u8*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total_size, flags));
+			MC_ASSERT(m_Mapped != nullptr, "Unable to persistently map the stream buffer");
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, total_size, nullptr, GL_STREAM_DRAW);
+			m_Staging.resize(total_size);
+		}
+	}
+
+	void StreamBuffer::Destroy()
+	{
+		if (m_Persistent && m_Mapped)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, m_Buffer);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+			m_Mapped = nullptr;
+		}
+
+		glDeleteBuffers(1, &m_Buffer);
+		m_Buffer = 0;
+	}
+
+	void StreamBuffer::WaitSegment(u32 segment)
+	{
+		GLsync& fence = m_Fences[segment];
+		if (!fence)
+			return;
+
+		//Flush on the first try, otherwise the fence could never be signaled
+		GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+		while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED)
+			flags = 0;
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	BlockDrawBatch::BlockDrawBatch()
+	{
+		//gl_DrawIDARB is needed to find the data of each draw in the shaders
+		m_MultiDrawSupported = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance && GLEW_ARB_shader_draw_parameters;
+
+		glGenBuffers(1, &m_CommandBuffer);
+		glGenBuffers(1, &m_DataBuffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, m_DataBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, sizeof(DrawData), nullptr, GL_STREAM_DRAW);
+
+		glGenTextures(1, &m_DataTexture);
+		glBindTexture(GL_TEXTURE_BUFFER, m_DataTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32I, m_DataBuffer);
+	}
+
+	BlockDrawBatch::~BlockDrawBatch()
+	{
+		glDeleteTextures(1, &m_DataTexture);
+		glDeleteBuffers(1, &m_DataBuffer);
+		glDeleteBuffers(1, &m_CommandBuffer);
+	}
+
+	void BlockDrawBatch::Add(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin, s32 selected_block)
+	{
+		m_Commands.push_back({ 6, count, 0, range.offset + first });
+		m_DrawData.push_back({ static_cast<s32>(chunk_origin.x), static_cast<s32>(chunk_origin.y), selected_block, 0 });
+	}
+
+	void BlockDrawBatch::Submit(Shader* shader, const VertexManager& vm, bool keep_commands)
+	{
+		Utils::Timer timer;
+		timer.StartTimer();
+
+		const u32 draw_count = static_cast<u32>(m_Commands.size());
+		if (draw_count > 0)
+		{
+			//Orphan the previous data, the GPU may still be reading it
+			glBindBuffer(GL_TEXTURE_BUFFER, m_DataBuffer);
+			glBufferData(GL_TEXTURE_BUFFER, m_DrawData.size() * sizeof(DrawData), m_DrawData.data(), GL_STREAM_DRAW);
+			StateCache& cache = *pstate->state_cache;
+			cache.BindBufferTexture(static_cast<u32>(Defs::TextureBinding::TextureChunkDrawData), m_DataTexture);
+
+			cache.UseProgram(shader);
+			cache.BindVertexArray(vm);
+			InstancePool& pool = *pstate->block_pool;
+			if (m_MultiDrawSupported && g_MultiDrawIndirect)
+			{
+				//The base instance of each command selects its faces in the pool
+				cache.Uniform1i(shader, 0, CachedUniform::DrawBase);
+				pool.BindInstances(0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, m_Commands.size() * sizeof(DrawCommand), m_Commands.data(), GL_STREAM_DRAW);
+				glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, draw_count, 0);
+			}
+			else
+			{
+				for (u32 i = 0; i < draw_count; i++)
+				{
+					cache.Uniform1i(shader, i, CachedUniform::DrawBase);
+					pool.BindInstances(m_Commands[i].base_instance);
+					Renderer::RenderInstanced(m_Commands[i].instance_count);
+				}
+			}
+		}
+
+		m_LastDrawCount = draw_count;
+		m_LastSubmitMilliseconds = timer.GetElapsedMilliseconds();
+		if (keep_commands)
+			return;
+
+		m_Commands.clear();
+		m_DrawData.clear();
+	}
+
+	bool BlockDrawBatch::MultiDrawSupported() const
+	{
+		return m_MultiDrawSupported;
+	}
+
+	f32 BlockDrawBatch::LastSubmitMilliseconds() const
+	{
+		return m_LastSubmitMilliseconds;
+	}
+
+	u32 BlockDrawBatch::LastDrawCount() const
+	{
+		return m_LastDrawCount;
+	}
+
+	void DispatchBlockRendering(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin, s32 selected_block)
+	{
+		pstate->block_draws->Add(range, first, count, chunk_origin, selected_block);
+	}
+	void DispatchDepthRendering(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin)
+	{
+		pstate->block_draws->Add(range, first, count, chunk_origin, -1);
+	}
+
+	void DispatchWaterRendering(const PoolRange& range, const glm::vec2& chunk_origin)
+	{
+		pstate->block_draws->Add(range, 0, range.count, chunk_origin, -1);
+	}
+
+	void SubmitBlockRendering()
+	{
+		pstate->block_draws->Submit(pstate->block_shader, *pstate->block_vm);
+	}
+	void SubmitDepthRendering()
+	{
+		pstate->block_draws->Submit(pstate->depth_shader, *pstate->depth_vm);
+	}
+	void SubmitWaterRendering()
+	{
+		pstate->block_draws->Submit(pstate->water_shader, *pstate->water_vm);
+	}
+	void SubmitDepthPrepass(const glm::mat4& view_proj)
+	{
+		//The scene shader computes the same positions with a different expression, pushing the
+		//prepass depth slightly back keeps its fragments passing the GL_LEQUAL test
+		pstate->state_cache->UniformMat4f(pstate->depth_shader, view_proj, CachedUniform::LightSpace);
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glEnable(GL_POLYGON_OFFSET_FILL);
+		glPolygonOffset(1.0f, 1.0f);
+		pstate->block_draws->Submit(pstate->depth_shader, *pstate->depth_vm, true);
+		glDisable(GL_POLYGON_OFFSET_FILL);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	}
+
+	FragmentCounter::FragmentCounter()
+	{
+		glGenQueries(g_StreamFrameCount, m_Queries.data());
+	}
+
+	FragmentCounter::~FragmentCounter()
+	{
+		glDeleteQueries(g_StreamFrameCount, m_Queries.data());
+	}
+
+	void FragmentCounter::Begin()
+	{
+		//The query of this slot was issued g_StreamFrameCount frames ago, skip it if it is still not ready
+		const u32 query = m_Queries[m_Current];
+		if (m_Pending[m_Current])
+		{
+			s32 available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint64 samples = 0;
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &samples);
+				m_LastSamples = samples;
+			}
+		}
+
+		glBeginQuery(GL_SAMPLES_PASSED, query);
+	}
+
+	void FragmentCounter::End()
+	{
+		glEndQuery(GL_SAMPLES_PASSED);
+		m_Pending[m_Current] = true;
+		m_Current = (m_Current + 1) % g_StreamFrameCount;
 	}
 
-	void DispatchBlockRendering(glm::vec3*& position_buf, u32*& texture_buf, u32& count)
+	u64 FragmentCounter::LastSamples() const
 	{
-		auto block_vm = pstate->block_vm;
+		return m_LastSamples;
+	}
 
-		pstate->block_shader->Use();
-		block_vm->BindVertexArray();
+	void StateCache::BeginFrame()
+	{
+		m_LastIssuedChanges = m_IssuedChanges;
+		m_LastElidedChanges = m_ElidedChanges;
+		m_IssuedChanges = 0;
+		m_ElidedChanges = 0;
+		InvalidateBindings();
+	}
 
-		//Unmap buffers for rendering and then remapping them
-		block_vm->UnmapAttributePointer(0);
-		block_vm->UnmapAttributePointer(1);
-		GlCore::Renderer::RenderInstanced(count);
-		position_buf = static_cast<glm::vec3*>(block_vm->InstancedAttributePointer(0));
-		texture_buf = static_cast<u32*>(block_vm->InstancedAttributePointer(1));
+	void StateCache::InvalidateBindings()
+	{
+		m_Program = nullptr;
+		m_VertexArray = nullptr;
+		m_Textures.fill({});
+	}
 
-		count = 0;
+	void StateCache::UseProgram(Shader* shader)
+	{
+		if (Issue(m_Program != shader)) {
+			shader->Use();
+			m_Program = shader;
+		}
 	}
-	void DispatchDepthRendering(glm::vec3*& position_buf, u32& count)
+
+	void StateCache::BindVertexArray(const VertexManager& vm)
 	{
-		auto depth_vm = pstate->depth_vm;
+		if (Issue(m_VertexArray != &vm)) {
+			vm.BindVertexArray();
+			m_VertexArray = &vm;
+		}
+	}
 
-		pstate->depth_shader->Use();
-		depth_vm->BindVertexArray();
+	void StateCache::BindTexture(u32 unit, const Texture& texture)
+	{
+		MC_ASSERT(unit < s_TextureUnits, "Texture unit out of the tracked range");
+		TextureUnit& bound = m_Textures[unit];
+		if (Issue(bound.object != &texture)) {
+			texture.Bind(unit);
+			bound = { &texture, 0 };
+		}
+	}
 
-		depth_vm->UnmapAttributePointer(0);
-		GlCore::Renderer::RenderInstanced(count);
-		position_buf = static_cast<glm::vec3*>(depth_vm->InstancedAttributePointer(0));
-		
-		count = 0;
+	void StateCache::BindFrameTexture(u32 unit, const FrameBuffer& framebuffer)
+	{
+		MC_ASSERT(unit < s_TextureUnits, "Texture unit out of the tracked range");
+		TextureUnit& bound = m_Textures[unit];
+		if (Issue(bound.object != &framebuffer)) {
+			framebuffer.BindFrameTexture(unit);
+			bound = { &framebuffer, 0 };
+		}
+	}
+
+	void StateCache::BindBufferTexture(u32 unit, u32 texture)
+	{
+		MC_ASSERT(unit < s_TextureUnits, "Texture unit out of the tracked range");
+		TextureUnit& bound = m_Textures[unit];
+		if (Issue(bound.object != nullptr || bound.handle != texture)) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			glBindTexture(GL_TEXTURE_BUFFER, texture);
+			bound = { nullptr, texture };
+		}
+	}
+
+	//Indexed by CachedUniform, the known values of a program are tracked in 16 bit masks
+	static_assert(static_cast<u32>(CachedUniform::Count) <= 16);
+	static constexpr std::array<const char*, static_cast<u32>(CachedUniform::Count)> s_UniformNames = {
+		"model", "lightSpace", "skybox", "draw_base", "texture_depth", "texture_screen",
+		"texture_inventory", "optional_texture_index", "instanced", "drop_texture_index"
+	};
+
+	void StateCache::Uniform1i(Shader* shader, s32 value, CachedUniform uniform)
+	{
+		ProgramUniforms& uniforms = UniformsOf(shader);
+		const u32 index = static_cast<u32>(uniform);
+		const u16 bit = static_cast<u16>(1u << index);
+		if (Issue(!(uniforms.known_ints & bit) || uniforms.ints[index] != value)) {
+			uniforms.ints[index] = value;
+			uniforms.known_ints |= bit;
+			shader->Uniform1i(value, s_UniformNames[index]);
+			m_Program = shader;
+		}
+	}
+
+	void StateCache::UniformMat4f(Shader* shader, const glm::mat4& value, CachedUniform uniform)
+	{
+		ProgramUniforms& uniforms = UniformsOf(shader);
+		const u32 index = static_cast<u32>(uniform);
+		const u16 bit = static_cast<u16>(1u << index);
+		if (Issue(!(uniforms.known_matrices & bit) || uniforms.matrices[index] != value)) {
+			uniforms.matrices[index] = value;
+			uniforms.known_matrices |= bit;
+			shader->UniformMat4f(value, s_UniformNames[index]);
+			m_Program = shader;
+		}
+	}
+
+	StateCache::ProgramUniforms& StateCache::UniformsOf(const Shader* shader)
+	{
+		//Only a handful of programs exist, a linear scan is cheaper than any lookup structure
+		for (u32 i = 0; i < m_TrackedProgramCount; i++)
+			if (m_Uniforms[i].shader == shader)
+				return m_Uniforms[i];
+
+		MC_ASSERT(m_TrackedProgramCount < s_TrackedPrograms, "Too many programs with cached uniforms");
+		ProgramUniforms& uniforms = m_Uniforms[m_TrackedProgramCount++];
+		uniforms.shader = shader;
+		return uniforms;
+	}
+
+	u32 StateCache::LastIssuedChanges() const
+	{
+		return m_LastIssuedChanges;
+	}
+
+	u32 StateCache::LastElidedChanges() const
+	{
+		return m_LastElidedChanges;
+	}
+
+	bool StateCache::Issue(bool needed)
+	{
+		if (needed)
+			m_IssuedChanges++;
+		else
+			m_ElidedChanges++;
+		return needed;
+	}
+
+	MatrixBlock::MatrixBlock()
+	{
+		glGenBuffers(1, &m_Buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Matrices), nullptr, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, g_MatricesBlockBinding, m_Buffer);
+	}
+
+	MatrixBlock::~MatrixBlock()
+	{
+		glDeleteBuffers(1, &m_Buffer);
+	}
+
+	void MatrixBlock::Attach(Shader* shader)
+	{
+		//GLSL 330 cannot declare the binding point, it is set on the linked program
+		shader->Use();
+		GLint program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+		const u32 block_index = glGetUniformBlockIndex(program, "Matrices");
+		MC_ASSERT(block_index != GL_INVALID_INDEX, "The shader does not declare the Matrices block");
+		glUniformBlockBinding(program, block_index, g_MatricesBlockBinding);
+	}
+
+	void MatrixBlock::Update(const glm::mat4& view, const glm::mat4& proj, const glm::mat4& light_space)
+	{
+		const Matrices matrices{ view, proj, light_space };
+		if (m_Uploaded && std::memcmp(&matrices, &m_Matrices, sizeof(Matrices)) == 0)
+			return;
+
+		m_Matrices = matrices;
+		m_Uploaded = true;
+		glBindBuffer(GL_UNIFORM_BUFFER, m_Buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Matrices), &m_Matrices);
+	}
+
+	//Toroidal slot coordinate of a tile coordinate
+	static u32 WrapTile(s32 tile)
+	{
+		constexpr s32 side = static_cast<s32>(ShadowTiles::s_TilesPerSide);
+		return static_cast<u32>(((tile % side) + side) % side);
+	}
+
+	ShadowTiles::ShadowTiles()
+	{
+		//No slot holds a tile yet
+		m_ResidentTiles.fill(glm::ivec2(std::numeric_limits<s32>::min()));
+	}
+
+	void ShadowTiles::Update(const glm::vec3& camera_position)
+	{
+		//The camera stays at least half a tile away from the edges of the window
+		const glm::ivec2 center_tile(glm::round(glm::vec2(camera_position.x, camera_position.z) / s_TileSize));
+		m_WindowOrigin = center_tile - glm::ivec2(s_TilesPerSide / 2);
+
+		for (u32 z = 0; z < s_TilesPerSide; z++)
+		{
+			for (u32 x = 0; x < s_TilesPerSide; x++)
+			{
+				const glm::ivec2 tile = m_WindowOrigin + glm::ivec2(x, z);
+				const u32 slot = WrapTile(tile.y) * s_TilesPerSide + WrapTile(tile.x);
+				if (m_ResidentTiles[slot] != tile) {
+					m_ResidentTiles[slot] = tile;
+					m_StaleSlots |= 1 << slot;
+				}
+			}
+		}
+	}
+
+	void ShadowTiles::Invalidate(const glm::vec2& min, const glm::vec2& max)
+	{
+		for (u32 slot = 0; slot < s_SlotCount; slot++)
+		{
+			glm::vec2 tile_min, tile_max;
+			TileRegion(slot, tile_min, tile_max);
+			if (min.x < tile_max.x && max.x > tile_min.x && min.y < tile_max.y && max.y > tile_min.y)
+				m_StaleSlots |= 1 << slot;
+		}
+	}
+
+	u16 ShadowTiles::StaleSlots() const
+	{
+		return m_StaleSlots;
+	}
+
+	void ShadowTiles::MarkUpdated(u32 slot)
+	{
+		m_StaleSlots &= ~(1 << slot);
+	}
+
+	void ShadowTiles::TileRegion(u32 slot, glm::vec2& min, glm::vec2& max) const
+	{
+		min = glm::vec2(m_ResidentTiles[slot]) * s_TileSize;
+		max = min + glm::vec2(s_TileSize);
+	}
+
+	glm::mat4 ShadowTiles::TileLightSpace(u32 slot) const
+	{
+		glm::vec2 min, max;
+		TileRegion(slot, min, max);
+		return LightSpace(min, max);
+	}
+
+	glm::mat4 ShadowTiles::WindowLightSpace() const
+	{
+		const glm::vec2 min = glm::vec2(m_WindowOrigin) * s_TileSize;
+		return LightSpace(min, min + glm::vec2(s_Extent));
+	}
+
+	glm::mat4 ShadowTiles::LightSpace(const glm::vec2& min, const glm::vec2& max)
+	{
+		//World X and Z become the light space X and Y, the light is 600 units high and looks down
+		glm::mat4 view(0.0f);
+		view[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+		view[1] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		view[2] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+		view[3] = glm::vec4(0.0f, 0.0f, -600.0f, 1.0f);
+		return glm::ortho(min.x, max.x, min.y, max.y, 0.1f, 650.0f) * view;
 	}
 }
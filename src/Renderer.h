@@ -3,6 +3,9 @@
 #include <thread>
 #include <mutex>
 #include <map>
+#include <optional>
+#include <array>
+#include <vector>
 #include "MainIncl.h"
 #include "GameDefinitions.h"
 #include "Vertices.h"
@@ -19,19 +22,353 @@ namespace GlCore
 	static constexpr bool g_MultithreadedRendering = false;
 #endif
 	static constexpr f32 g_FovDegrees = 60.0f;
-	static constexpr u32 g_MaxRenderedObjCount = 200000;
-	static constexpr u32 g_MaxWaterLayersCount = 200000;
+	//Packed block faces which can be stored at once in the instance pool
+	static constexpr u32 g_InstancePoolCapacity = 1 << 22;
+	//Location of the packed instance attribute in scene.shader and basic_shadow.shader
+	static constexpr u32 g_InstanceAttributeLocation = 1;
+	//Initial size of each stream buffer segment (drop instances), segments grow when needed
+	static constexpr u32 g_StreamSegmentSize = 1024 * 1024;
+	//Locations of the instanced drop transform (position, rotation) and item type in basic_collectable.shader
+	static constexpr u32 g_DropTransformLocation = 3;
+	static constexpr u32 g_DropTypeLocation = 4;
+	//Frames the CPU can write ahead of the GPU in the stream buffer
+	static constexpr u32 g_StreamFrameCount = 3;
+	//Uniform buffer binding point of the Matrices block (view, proj, light_space) shared by the world shaders
+	static constexpr u32 g_MatricesBlockBinding = 0;
 	static constexpr u32 g_DepthMapWidth = 1024;
 	static constexpr u32 g_DepthMapHeight = 1024;
 	extern std::atomic_bool g_LogicThreadShouldRun;
 	//thread id of the thread which is allowed to modify m_Chunks
 	extern std::atomic_bool g_SerializationRunning;
+	//Chunks merge their coplanar faces in larger quads instead of drawing one quad per block face
+	extern std::atomic_bool g_GreedyMeshing;
+	//Chunk draws of a pass are submitted with a single multi draw when supported
+	extern std::atomic_bool g_MultiDrawIndirect;
+	//Chunks hidden by the nearest terrain are culled with a software depth buffer
+	extern std::atomic_bool g_OcclusionCulling;
+	//Chunks which cannot be reached through empty space from the camera are culled
+	extern std::atomic_bool g_CaveCulling;
+	//Chunks below the horizon of the nearer terrain are culled
+	extern std::atomic_bool g_HorizonCulling;
+	//The depth of the visible chunks is drawn first, so that the scene shader runs about once per pixel
+	extern std::atomic_bool g_DepthPrepass;
 	//Framebuffer data
 	extern glm::vec3 g_FramebufferPlayerOffset;
 	extern glm::mat4 g_DepthSpaceMatrix;
 
-	void DispatchBlockRendering(glm::vec3*& position_buf, u32*& texture_buf, u32& count);
-	void DispatchDepthRendering(glm::vec3*& position_buf, u32& count);
+	//Block face instances are packed in 32 bits: local x (4 bits), local z (4 bits), y (8 bits),
+	//face index (3 bits), texture index (4 bits), and width - 1 and height - 1 (4 bits each)
+	//of the quad, which covers more blocks when greedy meshing merges coplanar faces.
+	//The chunk origin is uniformed for each draw, so positions are relative to it
+	inline u32 PackBlockInstance(glm::u8vec3 local_pos, u32 face, u32 tex_index, u32 width = 1, u32 height = 1)
+	{
+		return static_cast<u32>(local_pos.x) | (static_cast<u32>(local_pos.z) << 4) | (static_cast<u32>(local_pos.y) << 8) |
+			(face << 16) | (tex_index << 19) | ((width - 1) << 23) | ((height - 1) << 27);
+	}
+
+	//Position bits of a packed instance, used to tell the shader which block is selected
+	inline s32 PackedBlockPosition(glm::u8vec3 local_pos)
+	{
+		return static_cast<s32>(PackBlockInstance(local_pos, 0, 0));
+	}
+
+	//Range of the instance pool owned by a chunk, in instances
+	struct PoolRange
+	{
+		u32 offset = 0;
+		u32 capacity = 0;
+		u32 count = 0;
+	};
+
+	//Single GPU buffer holding the packed faces of every loaded chunk. Each chunk owns a sub-allocation
+	//which is rewritten only when the chunk gets dirty, so unchanged chunks cost just a draw call.
+	//Ranges can be freed by any thread (chunks are destroyed by the serialization thread too),
+	//GL calls happen only in the render thread
+	class InstancePool
+	{
+	public:
+		InstancePool(u32 capacity);
+		~InstancePool();
+		InstancePool(const InstancePool&) = delete;
+		InstancePool& operator=(const InstancePool&) = delete;
+
+		//Makes the instanced attribute of the vertex manager read from the pool
+		void AttachTo(const VertexManager& vm);
+		//Writes the instances in the range, moving it if they do not fit. Returns false if the pool is full,
+		//the range then keeps its previous instances
+		bool Upload(PoolRange& range, const u32* instances, u32 count);
+		void Free(PoolRange& range);
+		//Points the instanced attribute of the bound vertex manager at an instance of the pool
+		void BindInstances(u32 first_instance);
+	private:
+		std::optional<u32> AllocateRange(u32 capacity);
+		void FreeRange(u32 offset, u32 capacity);
+	private:
+		u32 m_Buffer;
+		//Free space sorted by offset, adjacent ranges are merged when freed
+		std::map<u32, u32> m_FreeRanges;
+		std::mutex m_Mutex;
+	};
+
+	//Ring buffer for the data written by the CPU every frame, split in one segment per frame in flight.
+	//With ARB_buffer_storage it stays persistently and coherently mapped, and each segment is fenced
+	//so that it is rewritten only once the GPU has consumed it. Otherwise (e.g. GL 3.3 contexts) writes
+	//go to a CPU copy which is uploaded on Commit. A segment grows instead of wrapping when a frame needs more space
+	class StreamBuffer
+	{
+	public:
+		StreamBuffer(u32 segment_size);
+		~StreamBuffer();
+		StreamBuffer(const StreamBuffer&) = delete;
+		StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+		//Waits until the GPU is done with the segment of this frame
+		void BeginFrame();
+		//Fences the current segment and moves to the next one
+		void EndFrame();
+		//Returns where to write size bytes, the pointer is valid until Commit
+		void* Reserve(u32 size);
+		//Makes the reserved bytes visible to the GPU and returns their offset in the buffer
+		u32 Commit();
+		u32 Handle() const;
+	private:
+		void Create(u32 segment_size);
+		void Destroy();
+		void WaitSegment(u32 segment);
+	private:
+		u32 m_Buffer = 0;
+		u32 m_SegmentSize = 0;
+		u32 m_Segment = 0;
+		//Write offset inside the current segment
+		u32 m_Head = 0;
+		u32 m_ReservedSize = 0;
+		bool m_Persistent = false;
+		u8* m_Mapped = nullptr;
+		//Used instead of the mapping when persistent mapping is not supported
+		std::vector<u8> m_Staging;
+		std::array<GLsync, g_StreamFrameCount> m_Fences{};
+	};
+
+	//Chunk draws collected during a pass and submitted at once, with a single glMultiDrawArraysIndirect
+	//when the context supports it or with one glDrawArraysInstanced each otherwise (GL 3.3).
+	//The chunk origin and selected block of each draw are read by the shaders from a buffer texture,
+	//indexed by gl_DrawIDARB or by the draw_base uniform in the fallback
+	class BlockDrawBatch
+	{
+	public:
+		BlockDrawBatch();
+		~BlockDrawBatch();
+		BlockDrawBatch(const BlockDrawBatch&) = delete;
+		BlockDrawBatch& operator=(const BlockDrawBatch&) = delete;
+
+		void Add(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin, s32 selected_block);
+		//Draws the collected commands, they are kept for another pass if keep_commands is true
+		void Submit(Shader* shader, const VertexManager& vm, bool keep_commands = false);
+
+		bool MultiDrawSupported() const;
+		//Statistics of the last submission, used to compare the two paths
+		f32 LastSubmitMilliseconds() const;
+		u32 LastDrawCount() const;
+	private:
+		//Same layout of DrawArraysIndirectCommand
+		struct DrawCommand
+		{
+			u32 vertex_count;
+			u32 instance_count;
+			u32 first_vertex;
+			u32 base_instance;
+		};
+
+		struct DrawData
+		{
+			s32 origin_x;
+			s32 origin_z;
+			s32 selected_block;
+			s32 unused;
+		};
+
+		std::vector<DrawCommand> m_Commands;
+		std::vector<DrawData> m_DrawData;
+		u32 m_CommandBuffer = 0;
+		u32 m_DataBuffer = 0;
+		u32 m_DataTexture = 0;
+		bool m_MultiDrawSupported = false;
+		f32 m_LastSubmitMilliseconds = 0.0f;
+		u32 m_LastDrawCount = 0;
+	};
+
+	//Both queue the faces of a single chunk in the instance pool for the current pass,
+	//selected_block is the packed position of the selected block or -1
+	void DispatchBlockRendering(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin, s32 selected_block);
+	void DispatchDepthRendering(const PoolRange& range, u32 first, u32 count, const glm::vec2& chunk_origin);
+	void DispatchWaterRendering(const PoolRange& range, const glm::vec2& chunk_origin);
+	//Submit the faces queued by the dispatch functions
+	void SubmitBlockRendering();
+	void SubmitDepthRendering();
+	void SubmitWaterRendering();
+	//Draws only the depth of the queued block faces from the camera, the faces stay queued for SubmitBlockRendering
+	void SubmitDepthPrepass(const glm::mat4& view_proj);
+
+	//Counts the samples passing the depth test during a pass with occlusion queries.
+	//Results are read g_StreamFrameCount frames later, so that the CPU never waits for the GPU
+	class FragmentCounter
+	{
+	public:
+		FragmentCounter();
+		~FragmentCounter();
+		FragmentCounter(const FragmentCounter&) = delete;
+		FragmentCounter& operator=(const FragmentCounter&) = delete;
+
+		void Begin();
+		void End();
+		//Samples of the last pass whose result is available
+		u64 LastSamples() const;
+	private:
+		std::array<u32, g_StreamFrameCount> m_Queries{};
+		std::array<bool, g_StreamFrameCount> m_Pending{};
+		u32 m_Current = 0;
+		u64 m_LastSamples = 0;
+	};
+
+	//Uniforms whose values are tracked by the StateCache, see s_UniformNames in Renderer.cpp for their names
+	enum class CachedUniform : u8
+	{
+		Model,
+		LightSpace,
+		Skybox,
+		DrawBase,
+		TextureDepth,
+		TextureScreen,
+		TextureInventory,
+		OptionalTextureIndex,
+		Instanced,
+		DropTextureIndex,
+		Count
+	};
+
+	//Tracks the program, vertex array, textures and uniforms last set through it, so that redundant
+	//changes are skipped. Shader uniforms bind their program, so the uniforms of a cached program
+	//must always be set through the cache. Bindings done elsewhere (resource creation, text rendering)
+	//are forgotten by BeginFrame and InvalidateBindings
+	class StateCache
+	{
+	public:
+		static constexpr u32 s_TextureUnits = 16;
+		static constexpr u32 s_TrackedPrograms = 16;
+
+		//Forgets the bindings and stores the counters of the last frame
+		void BeginFrame();
+		void InvalidateBindings();
+
+		void UseProgram(Shader* shader);
+		void BindVertexArray(const VertexManager& vm);
+		void BindTexture(u32 unit, const Texture& texture);
+		void BindFrameTexture(u32 unit, const FrameBuffer& framebuffer);
+		void BindBufferTexture(u32 unit, u32 texture);
+		//Uniform values are kept across frames, they are part of the program state
+		void Uniform1i(Shader* shader, s32 value, CachedUniform uniform);
+		void UniformMat4f(Shader* shader, const glm::mat4& value, CachedUniform uniform);
+
+		//Changes sent to the driver and changes skipped during the last frame
+		u32 LastIssuedChanges() const;
+		u32 LastElidedChanges() const;
+	private:
+		//Counts the change, returns true if it has to be issued
+		bool Issue(bool needed);
+
+		//Last values of the tracked uniforms of a program, a bit is set in the masks once a value is known
+		struct ProgramUniforms
+		{
+			const Shader* shader = nullptr;
+			u16 known_ints = 0;
+			u16 known_matrices = 0;
+			std::array<s32, static_cast<u32>(CachedUniform::Count)> ints{};
+			std::array<glm::mat4, static_cast<u32>(CachedUniform::Count)> matrices{};
+		};
+		ProgramUniforms& UniformsOf(const Shader* shader);
+
+		struct TextureUnit
+		{
+			//Texture or framebuffer bound through the engine, otherwise a raw GL handle
+			const void* object = nullptr;
+			u32 handle = 0;
+		};
+
+		Shader* m_Program = nullptr;
+		const VertexManager* m_VertexArray = nullptr;
+		std::array<TextureUnit, s_TextureUnits> m_Textures{};
+		std::array<ProgramUniforms, s_TrackedPrograms> m_Uniforms{};
+		u32 m_TrackedProgramCount = 0;
+		u32 m_IssuedChanges = 0;
+		u32 m_ElidedChanges = 0;
+		u32 m_LastIssuedChanges = 0;
+		u32 m_LastElidedChanges = 0;
+	};
+
+	//Uniform buffer holding the camera and light matrices of the frame, read by every shader
+	//declaring the std140 Matrices block instead of uploading them to each shader
+	class MatrixBlock
+	{
+	public:
+		MatrixBlock();
+		~MatrixBlock();
+		MatrixBlock(const MatrixBlock&) = delete;
+		MatrixBlock& operator=(const MatrixBlock&) = delete;
+
+		//Makes the Matrices block of the shader read from this buffer
+		void Attach(Shader* shader);
+		//Uploads the matrices once, only if one of them changed since the last frame
+		void Update(const glm::mat4& view, const glm::mat4& proj, const glm::mat4& light_space);
+	private:
+		//Same layout of the std140 block
+		struct Matrices
+		{
+			glm::mat4 view;
+			glm::mat4 proj;
+			glm::mat4 light_space;
+		};
+
+		Matrices m_Matrices{};
+		u32 m_Buffer = 0;
+		bool m_Uploaded = false;
+	};
+
+	//Shadow map split in world anchored tiles laid out toroidally: a world tile always lands in the same slot,
+	//so only the slots receiving a new tile or holding edited chunks have to be rendered again.
+	//The light looks straight down, the scene shader wraps the world XZ over s_Extent to sample it
+	class ShadowTiles
+	{
+	public:
+		static constexpr u32 s_TilesPerSide = 4;
+		static constexpr u32 s_SlotCount = s_TilesPerSide * s_TilesPerSide;
+		static constexpr f32 s_TileSize = 40.0f;
+		static constexpr f32 s_Extent = s_TileSize * s_TilesPerSide;
+		static constexpr u32 s_TilePixels = g_DepthMapWidth / s_TilesPerSide;
+
+		ShadowTiles();
+
+		//Centers the window of tiles around the camera, the slots which receive a new tile become stale
+		void Update(const glm::vec3& camera_position);
+		//Marks stale the resident tiles overlapping the XZ rectangle
+		void Invalidate(const glm::vec2& min, const glm::vec2& max);
+		//One bit for each slot, slot index is z * s_TilesPerSide + x
+		u16 StaleSlots() const;
+		void MarkUpdated(u32 slot);
+
+		//World XZ rectangle of the tile resident in the slot
+		void TileRegion(u32 slot, glm::vec2& min, glm::vec2& max) const;
+		//Light space of the single tile, used while rendering it in its slot
+		glm::mat4 TileLightSpace(u32 slot) const;
+		//Light space of the whole window, the scene shader uses it for the depth and the bounds
+		glm::mat4 WindowLightSpace() const;
+	private:
+		static glm::mat4 LightSpace(const glm::vec2& min, const glm::vec2& max);
+
+		std::array<glm::ivec2, s_SlotCount> m_ResidentTiles;
+		//Tile coordinates of the first tile of the window
+		glm::ivec2 m_WindowOrigin{ 0 };
+		u16 m_StaleSlots = 0xFFFF;
+	};
 
 	class Renderer
 	{
@@ -6,6 +6,7 @@
 #include "Shader.h"
 #include "FrameBuffer.h"
 #include "Memory.h"
+#include "Renderer.h"
 
 namespace GlCore
 {
@@ -33,6 +34,11 @@ namespace GlCore
 		Memory::DeleteUnchecked(arena, crossaim_vm);
 		Memory::DeleteUnchecked(arena, decal2d_vm);
 		Memory::DeleteUnchecked(arena, screen_vm);
+		Memory::DeleteUnchecked(arena, block_pool);
+		Memory::DeleteUnchecked(arena, stream_buffer);
+		Memory::DeleteUnchecked(arena, block_draws);
+		Memory::DeleteUnchecked(arena, state_cache);
+		Memory::DeleteUnchecked(arena, matrix_block);
 
 		Memory::DeleteUnchecked(arena, screen_framebuffer);
 		Memory::DeleteUnchecked(arena, shadow_framebuffer);
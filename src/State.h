@@ -15,7 +15,11 @@ namespace Memory {
 
 namespace GlCore
 {
-
+	class InstancePool;
+	class StreamBuffer;
+	class BlockDrawBatch;
+	class StateCache;
+	class MatrixBlock;
 
 	struct State
 	{
@@ -48,6 +52,16 @@ namespace GlCore
 		//This is used to render 2d sprites when the player holds them
 		VertexManager*			decal2d_vm;
 		VertexManager*			screen_vm;
+		//Packed block faces and water rectangles of every loaded chunk, drawn through block_vm, depth_vm and water_vm
+		InstancePool*			block_pool;
+		//Ring buffer for the data written every frame (drop instances)
+		StreamBuffer*			stream_buffer;
+		//Chunk draws of the current pass
+		BlockDrawBatch*			block_draws;
+		//Skips redundant program, vertex array, texture and uniform changes
+		StateCache*				state_cache;
+		//View, projection and light space matrices of the frame
+		MatrixBlock*			matrix_block;
 
 		//Framebuffer on which all the scene drawcalls will be executed
 		FrameBuffer*			screen_framebuffer;
@@ -1,4 +1,5 @@
 #include "Utils.h"
+#include <algorithm>
 
 namespace Utils
 {
@@ -29,6 +30,78 @@ namespace Utils
 		return is_block ? glm::radians(fov_degrees * block_ratio) : glm::radians(fov_degrees * item_ratio);
 	}
 
+	WorkerPool::WorkerPool()
+	{
+		//The thread calling ParallelFor is the last worker
+		const u32 worker_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+		m_Threads.reserve(worker_count);
+		for (u32 i = 0; i < worker_count; i++)
+			m_Threads.emplace_back(&WorkerPool::WorkerLoop, this);
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Stop = true;
+		}
+		m_WakeCondition.notify_all();
+
+		for (auto& thread : m_Threads)
+			thread.join();
+	}
+
+	void WorkerPool::ParallelFor(u32 count, const std::function<void(u32)>& fn)
+	{
+		if (count == 0)
+			return;
+
+		std::lock_guard<std::mutex> loop_lock(m_LoopMutex);
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Job = &fn;
+			m_Count = count;
+			m_NextIndex = 0;
+			m_ActiveWorkers = static_cast<u32>(m_Threads.size());
+			m_Generation++;
+		}
+		m_WakeCondition.notify_all();
+
+		Drain();
+
+		//fn must outlive the workers still finishing their last index
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_DoneCondition.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+		m_Job = nullptr;
+	}
+
+	void WorkerPool::WorkerLoop()
+	{
+		u64 generation = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_Mutex);
+				m_WakeCondition.wait(lock, [this, generation]() { return m_Stop || m_Generation != generation; });
+				if (m_Stop)
+					return;
+				generation = m_Generation;
+			}
+
+			Drain();
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_ActiveWorkers == 0)
+				m_DoneCondition.notify_one();
+		}
+	}
+
+	void WorkerPool::Drain()
+	{
+		//m_Job and m_Count are only written while no worker is draining
+		for (u32 index = m_NextIndex++; index < m_Count; index = m_NextIndex++)
+			(*m_Job)(index);
+	}
 
 	Serializer::Serializer(const std::string& filename, const char* mode)
 	{
@@ -6,6 +6,9 @@
 #include <chrono>
 #include <fstream>
 #include <utility>
+#include <atomic>
+#include <thread>
+#include <functional>
 #ifdef __linux__
 #include <cstring>
 #endif
@@ -72,6 +75,38 @@ namespace Utils
 		std::chrono::steady_clock::time_point m_TimePoint;
 	};
 
+	//Threads started once and reused by every parallel loop, so that a loop does not pay
+	//for spawning its workers. The calling thread works on the loop too
+	class WorkerPool
+	{
+	public:
+		WorkerPool();
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		~WorkerPool();
+
+		//Calls fn(index) for each index in [0, count) and returns once every call is done.
+		//Loops from different threads run one after the other
+		void ParallelFor(u32 count, const std::function<void(u32)>& fn);
+
+	private:
+		void WorkerLoop();
+		void Drain();
+
+		std::vector<std::thread> m_Threads;
+		std::mutex m_LoopMutex;
+		std::mutex m_Mutex;
+		std::condition_variable m_WakeCondition;
+		std::condition_variable m_DoneCondition;
+		//Loop being run, each new loop bumps m_Generation to wake the workers
+		const std::function<void(u32)>* m_Job = nullptr;
+		u32 m_Count = 0;
+		std::atomic<u32> m_NextIndex = 0;
+		u32 m_ActiveWorkers = 0;
+		u64 m_Generation = 0;
+		bool m_Stop = false;
+	};
+
 	//Serializes object on the disk
 	//As a convention, the & operator means serialization
 	//and the % operator means deserialization
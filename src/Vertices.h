@@ -9,10 +9,6 @@ namespace Memory {
 
 namespace GlCore
 {
-    //Pair consisting of an array of integers which represents the initial data
-    //vertex for each cube face, and an integer which denotes how many faces
-    //are being rendered
-    using DrawableData = std::pair<std::array<u8, 3>, u8>;
     static constexpr f32 one_third = 1.0f / 3.0f;
     static constexpr u32 global_texture_offsets_count = 10;
 
@@ -35,10 +31,12 @@ namespace GlCore
         MeshElement pos_and_tex_coord_depth;
         MeshElement pos_and_tex_coords_decal2d;
         MeshElement pos_and_tex_coords_screen;
-        MeshElement water_layer;
         MeshElement crossaim;
         MeshElement inventory;
         MeshElement inventory_entry;
+        //Corner indices of a single face, the block shaders expand them
+        //to the face selected by each instance
+        MeshElement face_quad;
     };
 
     //Functions that return the raw buffer layout.
@@ -46,15 +44,14 @@ namespace GlCore
     Layout PosAndTexCoordDefaultLayout();
     Layout PosAndTexCoordDecal2DLayout();
     Layout PosAndTexCoordsScreenLayout();
-    Layout WaterLayerLayout();
     Layout PosAndTexCoordsDepthLayout();
     Layout CrossaimLayout();
     Layout InventoryLayout();
     Layout InventoryEntryLayout();
+    Layout FaceQuadLayout();
 
     MeshStorage AllocateMeshStorage(Memory::Arena* arena);
     void FreeMeshStorage(MeshStorage& storage, Memory::Arena* arena);
-    u8 GetNormVertexBegin(const glm::vec3& vec);
 
     TextureOffsets LoadGlobalTextureOffsets();
 }
\ No newline at end of file
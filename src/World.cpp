@@ -2,10 +2,11 @@
 #include "Renderer.h"
 #include "InventorySystem.h"
 #include <atomic>
+#include <algorithm>
 
 //Initializing a single block for now
 World::World()
-	: m_State(*GlCore::pstate), m_LastPos(0.0f)
+	: m_State(*GlCore::pstate)
 {
 	using namespace Defs;
 
@@ -37,9 +38,12 @@ World::World()
 	m_WorldSeed.seed_value = 1;
 	PerlNoise::InitSeedMap(m_WorldSeed);
 
-	for (s32 i = g_SpawnerBegin; i < g_SpawnerEnd; i += g_SpawnerIncrement)
-		for (s32 j = g_SpawnerBegin; j < g_SpawnerEnd; j += g_SpawnerIncrement) 
+	for (s32 i = g_SpawnerBegin; i < g_SpawnerEnd; i += g_SpawnerIncrement) {
+		for (s32 j = g_SpawnerBegin; j < g_SpawnerEnd; j += g_SpawnerIncrement) {
 			m_Chunks.push_back(Memory::New<Chunk>(m_State.memory_arena, *this, glm::vec2(f32(i), f32(j))));
+			RegisterChunk(m_Chunks.back());
+		}
+	}
 
 	HandleSectionData();
 
@@ -67,9 +71,6 @@ World::World()
 		chunk.InitGlobalNorms();
 	}
 
-	//Set proj matrix, won't vary for now in the app
-	GlCore::UniformProjMatrix();
-
 	//Load water texture
 	const u32 global_texture_index = static_cast<u32>(Defs::TextureBinding::GlobalTexture);
 	m_State.game_textures[global_texture_index].Bind(global_texture_index);
@@ -84,59 +85,83 @@ World::~World()
 
 	for (auto chunk_addr : m_Chunks)
 		Memory::Delete<Chunk>(m_State.memory_arena, chunk_addr);
+	for (auto& [key, mesh] : m_ChunkMeshes)
+		mesh.Free();
 }
 
-void World::Render(const Inventory& inventory, const glm::vec3& camera_position, const glm::vec3& camera_direction)
+void World::AcquireRenderPacket()
 {
-	//Draw to depth framebuffer
-	auto block_vm = m_State.block_vm;
-	auto depth_vm = m_State.depth_vm;
+	if (!m_RenderPackets.Acquire())
+		return;
 
-	//Map the shader buffers so we can use them to write data
-	glm::vec3* block_positions = static_cast<glm::vec3*>(block_vm->InstancedAttributePointer(0));
-	glm::vec3* depth_positions = static_cast<glm::vec3*>(depth_vm->InstancedAttributePointer(0));
-	glm::vec3* water_positions = static_cast<glm::vec3*>(m_State.water_vm->InstancedAttributePointer(0));
-	u32* block_texindices = static_cast<u32*>(block_vm->InstancedAttributePointer(1));
+	//Packets recorded before the previous correction reached the camera start from the same position,
+	//their collision was already applied
+	const RenderPacket& packet = m_RenderPackets.ReadSlot();
+	if (packet.camera_position == m_CorrectedPosition)
+		return;
 
-	u32 count = 0, water_layer_count = 0;
+	m_CorrectedPosition = packet.camera_position;
+	Physics::ApplyCollision(packet.collision, *m_State.camera);
+}
+
+void World::Render(const Inventory& inventory, const glm::vec3& camera_position)
+{
+	//Data written by the CPU this frame goes to the stream buffer (drop instances)
+	GlCore::StreamBuffer& stream_buffer = *m_State.stream_buffer;
+	stream_buffer.BeginFrame();
+	GlCore::StateCache& state_cache = *m_State.state_cache;
+	state_cache.BeginFrame();
 
 	glEnable(GL_DEPTH_TEST);
 
-	//If at least one of this conditions are verified, we need to update the shadow texture
-	if (Defs::g_EnvironmentChange || glm::length(m_LastPos - camera_position) > 20.0f)
-	{
-		//Reset state
-		Defs::g_EnvironmentChange = false;
-		m_LastPos = camera_position;
+	//The last packet stays in use until the logic thread publishes a newer one
+	const RenderPacket& packet = m_RenderPackets.ReadSlot();
+	ApplyMeshUpdates(packet.sequence);
+	m_RenderedTriangles = 0;
 
-		glViewport(0, 0, GlCore::g_DepthMapWidth, GlCore::g_DepthMapHeight);
+	//Only the shadow tiles which scrolled into view or hold rebuilt chunks are rendered again
+	m_ShadowTiles.Update(camera_position);
+	GlCore::g_DepthSpaceMatrix = m_ShadowTiles.WindowLightSpace();
+	if (const u16 stale_slots = m_ShadowTiles.StaleSlots())
+	{
 		m_State.shadow_framebuffer->Bind();
-		Window::ClearScreen(GL_DEPTH_BUFFER_BIT);
+		glEnable(GL_SCISSOR_TEST);
 
-		//Update depth framebuffer
-		GlCore::UpdateShadowFramebuffer();
-
-		for (u32 i = 0; i < m_Chunks.size(); i++)
+		for (u32 slot = 0; slot < GlCore::ShadowTiles::s_SlotCount; slot++)
 		{
-			//Interrupt for a moment if m_Chunks is being resized by the logic thread
-			Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
-			//Chunk has probably been serialized (should mostly never happen)
-			if (!chunk)
-				break;
-
-			if (chunk->IsChunkRenderable(camera_position))
-				chunk->ForwardRenderableData(depth_positions, block_texindices, count, true);
+			if (!(stale_slots & (1 << slot)))
+				continue;
+
+			//Scissored so that the clear leaves the other tiles untouched
+			const s32 x = (slot % GlCore::ShadowTiles::s_TilesPerSide) * GlCore::ShadowTiles::s_TilePixels;
+			const s32 y = (slot / GlCore::ShadowTiles::s_TilesPerSide) * GlCore::ShadowTiles::s_TilePixels;
+			glViewport(x, y, GlCore::ShadowTiles::s_TilePixels, GlCore::ShadowTiles::s_TilePixels);
+			glScissor(x, y, GlCore::ShadowTiles::s_TilePixels, GlCore::ShadowTiles::s_TilePixels);
+			Window::ClearScreen(GL_DEPTH_BUFFER_BIT);
+
+			GlCore::UpdateShadowFramebuffer(m_ShadowTiles.TileLightSpace(slot));
+
+			//Casters are culled against the tile, the light frustum of the tile is a vertical box
+			glm::vec2 tile_min, tile_max;
+			m_ShadowTiles.TileRegion(slot, tile_min, tile_max);
+			for (const ChunkRenderRecord& record : packet.chunks)
+			{
+				const glm::vec2 chunk_min = record.origin - glm::vec2(0.5f);
+				const glm::vec2 chunk_max = chunk_min + glm::vec2(Chunk::s_ChunkWidthAndHeight);
+				if (chunk_min.x < tile_max.x && chunk_max.x > tile_min.x && chunk_min.y < tile_max.y && chunk_max.y > tile_min.y)
+					if (const ChunkMesh* mesh = FindMesh(record))
+						mesh->RenderFaces(record, camera_position, true);
+			}
+			GlCore::SubmitDepthRendering();
+			m_ShadowTiles.MarkUpdated(slot);
 		}
 
-		//Render any leftover data
-		GlCore::DispatchDepthRendering(depth_positions, count);
-
+		glDisable(GL_SCISSOR_TEST);
 		u32 depth_binding = static_cast<u32>(Defs::TextureBinding::TextureDepthFramebuffer);
-		m_State.shadow_framebuffer->BindFrameTexture(depth_binding);
-		m_State.block_shader->Uniform1i(depth_binding, "texture_depth");
+		state_cache.BindFrameTexture(depth_binding, *m_State.shadow_framebuffer);
+		state_cache.Uniform1i(m_State.block_shader, depth_binding, GlCore::CachedUniform::TextureDepth);
 
 		glViewport(0, 0, Defs::g_ScreenWidth, Defs::g_ScreenHeight);
-		//FrameBuffer::BindDefault();
 	}
 
 	//Scene renderpass
@@ -145,41 +170,83 @@ void World::Render(const Inventory& inventory, const glm::vec3& camera_position,
 
 	GlCore::RenderSkybox();
 
-	u32 ch = Defs::g_SelectedChunk.load();
-	//Setting selected block index, which will be used only by the owning chunk
-	Chunk::s_InternalSelectedBlock = Defs::g_SelectedBlock.load();	
-	//Uniform light space matrix
-	m_State.block_shader->UniformMat4f(GlCore::g_DepthSpaceMatrix, "light_space");
+	//Camera and light space matrices of the frame, shared by the block, water and drop shaders
+	Camera& camera = *m_State.camera;
+	m_State.matrix_block->Update(camera.GetViewMatrix(), camera.GetProjMatrix(), GlCore::g_DepthSpaceMatrix);
 
-	//Draw to scene
-	for (u32 i = 0; i < m_Chunks.size(); i++)
+	//Frustum test of the renderable chunks, done in one batch over their bounds. The distance is tested
+	//again with the camera of this frame, the packet was gathered around an older one
+	m_ChunkBounds.Clear();
+	m_BoundedChunks.clear();
+	for (u32 i = 0; i < packet.chunks.size(); i++)
 	{
-		//Wait if the vector is being modified
-		Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
-		if (!chunk)
-			break;
-
-		if (chunk->IsChunkRenderable(camera_position) && chunk->IsChunkVisible(camera_position, camera_direction)) {
-			chunk->ForwardRenderableData(block_positions, block_texindices, count, false, ch == i);
-			chunk->RenderDrops();
-
-			//Add possible water positions
-			chunk->AddWaterLayerIfPresent(water_positions, water_layer_count);
+		const ChunkRenderRecord& record = packet.chunks[i];
+		if (record.IsRenderable(camera_position) && FindMesh(record)) {
+			m_ChunkBounds.Push(record.bounds_min, record.bounds_max);
+			m_BoundedChunks.push_back(i);
 		}
 	}
 
-	//Render any leftover data
-	GlCore::DispatchBlockRendering(block_positions, block_texindices, count);
+	const glm::mat4 view_proj = camera.GetProjMatrix() * camera.GetViewMatrix();
+	const Culling::Frustum frustum = Culling::ExtractFrustum(view_proj);
+	m_FrustumVisibility.resize(m_ChunkBounds.Size());
+	Culling::TestFrustum(frustum, m_ChunkBounds, m_FrustumVisibility.data());
+
+	m_TestedChunks = m_ChunkBounds.Size();
+	m_FrustumCulledChunks = static_cast<u32>(std::count(m_FrustumVisibility.begin(), m_FrustumVisibility.end(), 0));
+	m_HorizonCulledChunks = 0;
+	if (GlCore::g_HorizonCulling)
+		CullBelowHorizon(packet, camera_position);
+	m_CaveCulledChunks = 0;
+	if (GlCore::g_CaveCulling)
+		CullUnreachableChunks(packet, camera_position);
+	m_OccludedChunks = 0;
+	if (GlCore::g_OcclusionCulling)
+		CullOccludedChunks(packet, view_proj, camera_position);
 
-	//Draw water layers(normal instanced rendering for the water layer)
-	glEnable(GL_BLEND);
-	m_State.water_shader->Use();
-	m_State.water_vm->BindVertexArray();
-	//Render water layers which have been set by AddWaterLayerIfPresent
-	m_State.water_vm->UnmapAttributePointer(0);
-	GlCore::Renderer::RenderInstanced(water_layer_count);
+	//Draw to scene
+	SortFrontToBack(packet, camera_position, m_VisibleOrder);
+	m_VisibleChunks.clear();
+	for (u32 j : m_VisibleOrder)
+	{
+		const ChunkRenderRecord& record = packet.chunks[m_BoundedChunks[j]];
+		const ChunkMesh* mesh = FindMesh(record);
+		m_RenderedTriangles += mesh->RenderFaces(record, camera_position, false) * 2;
+		m_VisibleChunks.emplace_back(mesh, &record);
+	}
 
-	glDisable(GL_BLEND);
+	//Visibility of this frame, shared with the logic thread once published
+	const u32 buffer_index = 1 - m_PublishedVisibility;
+	VisibilitySet& visibility = m_VisibilitySets[buffer_index];
+	visibility.frame = ++m_FrameIndex;
+	visibility.chunks.clear();
+	for (const auto& [mesh, record] : m_VisibleChunks)
+		visibility.chunks.push_back(record->chunk_coords);
+	PublishVisibility(buffer_index);
+
+	const bool depth_prepass = GlCore::g_DepthPrepass;
+	if (depth_prepass) {
+		GlCore::SubmitDepthPrepass(view_proj);
+		glDepthFunc(GL_LEQUAL);
+	}
+	m_SceneSamples.Begin();
+	GlCore::SubmitBlockRendering();
+	m_SceneSamples.End();
+	if (depth_prepass)
+		glDepthFunc(GL_LESS);
+
+	m_RenderedDrops = m_Drops.Render(frustum, camera_position, stream_buffer);
+
+	//Water surfaces, cached in the instance pool as merged rectangles and drawn after the opaque geometry
+	m_RenderedWaterRects = 0;
+	for (const auto& [mesh, record] : m_VisibleChunks)
+		m_RenderedWaterRects += mesh->RenderWater(*record);
+	if (m_RenderedWaterRects > 0)
+	{
+		glEnable(GL_BLEND);
+		GlCore::SubmitWaterRendering();
+		glDisable(GL_BLEND);
+	}
 
 	GlCore::RenderCrossaim();
 
@@ -189,8 +256,8 @@ void World::Render(const Inventory& inventory, const glm::vec3& camera_position,
 	glDisable(GL_DEPTH_TEST);
 
 	u32 screen_framebuffer_binding = static_cast<u32>(Defs::TextureBinding::TextureScreenFramebuffer);
-	m_State.screen_framebuffer->BindFrameTexture(screen_framebuffer_binding);
-	m_State.screen_shader->Uniform1i(screen_framebuffer_binding, "texture_screen");
+	state_cache.BindFrameTexture(screen_framebuffer_binding, *m_State.screen_framebuffer);
+	state_cache.Uniform1i(m_State.screen_shader, screen_framebuffer_binding, GlCore::CachedUniform::TextureScreen);
 	GlCore::Renderer::Render(m_State.screen_shader, *m_State.screen_vm, nullptr, {});
 
 	glEnable(GL_DEPTH_TEST);
@@ -204,13 +271,514 @@ void World::Render(const Inventory& inventory, const glm::vec3& camera_position,
 		glDisable(GL_BLEND);
 	}
 	glDisable(GL_DEPTH_TEST);
+
+	stream_buffer.EndFrame();
+}
+
+void World::RecordRenderPacket(const glm::vec3& camera_position, const Physics::Collision& collision)
+{
+	const u64 sequence = m_RecordedSequence + 1;
+	RebuildChunkMeshes(camera_position, sequence);
+
+	RenderPacket& packet = m_RenderPackets.WriteSlot();
+	packet.Clear();
+	packet.sequence = sequence;
+	packet.camera_position = camera_position;
+	packet.collision = collision;
+
+	const u32 selected_block = Defs::g_SelectedBlock;
+	const f32 occluder_distance = s_OccluderDistance + s_RecordMargin;
+	for (u32 i = 0; i < m_Chunks.size(); i++)
+	{
+		//Wait if the vector is being modified
+		Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
+		if (!chunk)
+			break;
+
+		ChunkRenderRecord record;
+		if (!chunk->IsChunkRenderable(camera_position, s_RecordMargin) || !chunk->FillRenderRecord(record))
+			continue;
+
+		if (chunk == m_SelectedChunk && selected_block < chunk->chunk_blocks.size())
+			record.selected_block = GlCore::PackedBlockPosition(chunk->chunk_blocks[selected_block].position);
+
+		//Only the chunks near the camera can be picked as occluders by the render thread
+		const glm::vec2 offset = record.center - glm::vec2(camera_position.x, camera_position.z);
+		if (glm::dot(offset, offset) < occluder_distance * occluder_distance) {
+			record.first_occluder = packet.occluders.Size();
+			chunk->AppendOccluders(packet.occluders);
+			record.occluder_count = packet.occluders.Size() - record.first_occluder;
+		}
+
+		packet.chunks.push_back(record);
+	}
+
+	m_RenderPackets.Publish();
+	m_RecordedSequence = sequence;
+}
+
+void World::RebuildChunkMeshes(const glm::vec3& camera_position, u64 sequence)
+{
+	//Switching the meshing backend invalidates every chunk
+	const bool greedy = GlCore::g_GreedyMeshing;
+	const bool backend_changed = greedy != m_GreedyMeshingBuilt;
+	m_GreedyMeshingBuilt = greedy;
+
+	if (backend_changed)
+		for (u32 i = 0; i < m_Chunks.size(); i++)
+			if (Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]))
+				chunk->MarkAllChanged(Changes::RenderBuffer);
+
+	//Lost events can only be recovered by looking at every chunk
+	const bool rescan = m_RenderChanges.ConsumeOverflow() || backend_changed;
+	Utils::Vector<Chunk*> dirty_chunks;
+	CollectDirtyChunks(camera_position, rescan, dirty_chunks);
+	if (dirty_chunks.empty())
+		return;
+
+	//Meshes are built in parallel, the render thread uploads them once it draws this sequence
+	Utils::Vector<ChunkMeshUpdate> updates(dirty_chunks.size());
+	m_Workers.ParallelFor(dirty_chunks.size(), [&](u32 i) { dirty_chunks[i]->BuildMeshUpdate(updates[i], greedy); });
+
+	std::lock_guard<std::mutex> lock{ m_MeshUpdateMutex };
+	for (ChunkMeshUpdate& update : updates)
+	{
+		update.sequence = sequence;
+		m_MeshUpdates.push_back(std::move(update));
+	}
+}
+
+void World::QueueMeshRelease(const Chunk& chunk)
+{
+	ChunkMeshUpdate update;
+	update.chunk_coords = chunk.ChunkCoords();
+	update.chunk_origin = chunk.ChunkOrigin2D();
+	update.release = true;
+
+	//Read under the lock, so that the queue stays sorted by sequence
+	std::lock_guard<std::mutex> lock{ m_MeshUpdateMutex };
+	update.sequence = m_RecordedSequence + 1;
+	m_MeshUpdates.push_back(std::move(update));
+}
+
+void World::ApplyMeshUpdates(u64 sequence)
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_MeshUpdateMutex };
+		u32 taken = 0;
+		while (taken < m_MeshUpdates.size() && m_MeshUpdates[taken].sequence <= sequence)
+			taken++;
+
+		for (u32 i = 0; i < taken; i++)
+			m_ReadyUpdates.push_back(std::move(m_MeshUpdates[i]));
+		m_MeshUpdates.erase(m_MeshUpdates.begin(), m_MeshUpdates.begin() + taken);
+	}
+
+	if (m_ReadyUpdates.empty())
+		return;
+
+	//Only the last update of a chunk is applied, it takes over the water and shadow changes of the older ones
+	Utils::UnorderedMap<u64, u32> latest;
+	for (u32 i = static_cast<u32>(m_ReadyUpdates.size()); i-- > 0;)
+	{
+		ChunkMeshUpdate& update = m_ReadyUpdates[i];
+		auto [iter, inserted] = latest.try_emplace(RegistryKey(update.chunk_coords), i);
+		if (inserted)
+			continue;
+
+		ChunkMeshUpdate& newer = m_ReadyUpdates[iter->second];
+		if (!newer.release)
+		{
+			newer.shadow_changed |= update.shadow_changed || update.release;
+			if (!newer.water_changed && update.water_changed) {
+				newer.water_changed = true;
+				newer.water_rects = std::move(update.water_rects);
+			}
+		}
+		update.sequence = s_SupersededUpdate;
+	}
+
+	//The shadow of a chunk lies right below it, a meshing backend switch alone does not move it
+	auto invalidate_shadow = [&](const ChunkMeshUpdate& update) {
+		const glm::vec2 chunk_min = update.chunk_origin - glm::vec2(0.5f);
+		m_ShadowTiles.Invalidate(chunk_min, chunk_min + glm::vec2(Chunk::s_ChunkWidthAndHeight));
+	};
+
+	u32 kept = 0;
+	for (u32 i = 0; i < m_ReadyUpdates.size(); i++)
+	{
+		ChunkMeshUpdate& update = m_ReadyUpdates[i];
+		if (update.sequence == s_SupersededUpdate)
+			continue;
+
+		const u64 key = RegistryKey(update.chunk_coords);
+		if (update.release)
+		{
+			if (auto iter = m_ChunkMeshes.find(key); iter != m_ChunkMeshes.end()) {
+				iter->second.Free();
+				m_ChunkMeshes.erase(iter);
+				invalidate_shadow(update);
+			}
+			continue;
+		}
+
+		//Try again next frame if the pool is full
+		if (!m_ChunkMeshes[key].Apply(update)) {
+			if (kept != i)
+				m_ReadyUpdates[kept] = std::move(update);
+			kept++;
+			continue;
+		}
+
+		if (update.shadow_changed)
+			invalidate_shadow(update);
+	}
+	m_ReadyUpdates.resize(kept);
+}
+
+const ChunkMesh* World::FindMesh(const ChunkRenderRecord& record) const
+{
+	auto iter = m_ChunkMeshes.find(RegistryKey(record.chunk_coords));
+	return iter != m_ChunkMeshes.end() ? &iter->second : nullptr;
+}
+
+void World::CollectDirtyChunks(const glm::vec3& camera_position, bool rescan, Utils::Vector<Chunk*>& dirty_chunks)
+{
+	//Keyed by coordinates, a chunk is pending once however many events or rescans report it
+	auto add_pending = [&](const glm::ivec2& chunk_coords) { m_PendingRebuilds.try_emplace(RegistryKey(chunk_coords), chunk_coords); };
+
+	Changes::Event event;
+	while (m_RenderChanges.Pop(event))
+		add_pending(event.chunk_coords);
+
+	if (rescan)
+	{
+		for (u32 i = 0; i < m_Chunks.size(); i++)
+		{
+			Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
+			if (!chunk)
+				break;
+
+			if (chunk->HasChange(Changes::RenderBuffer))
+				add_pending(chunk->ChunkCoords());
+		}
+	}
+
+	//Chunks out of the rendering distance stay pending, the ones unloaded or already rebuilt are dropped
+	for (auto iter = m_PendingRebuilds.begin(); iter != m_PendingRebuilds.end();)
+	{
+		Chunk* chunk = ChunkAt(iter->second);
+		const bool dirty = chunk && chunk->HasChange(Changes::RenderBuffer);
+		if (dirty && !chunk->IsChunkRenderable(camera_position, s_RecordMargin)) {
+			++iter;
+			continue;
+		}
+
+		if (dirty)
+			dirty_chunks.push_back(chunk);
+		iter = m_PendingRebuilds.erase(iter);
+	}
+}
+
+u32 World::RenderedTriangles() const
+{
+	return m_RenderedTriangles;
+}
+
+void World::CullBelowHorizon(const RenderPacket& packet, const glm::vec3& camera_position)
+{
+	Utils::Timer timer;
+	timer.StartTimer();
+
+	//Front to back, so that each chunk is tested against the terrain between it and the camera
+	m_HorizonOrder.clear();
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+	{
+		const glm::vec2 nearest = glm::clamp(glm::vec2(camera_position.x, camera_position.z),
+			glm::vec2(m_ChunkBounds.min_x[j], m_ChunkBounds.min_z[j]), glm::vec2(m_ChunkBounds.max_x[j], m_ChunkBounds.max_z[j]));
+		const glm::vec2 offset = nearest - glm::vec2(camera_position.x, camera_position.z);
+		m_HorizonOrder.emplace_back(glm::dot(offset, offset), j);
+	}
+	std::sort(m_HorizonOrder.begin(), m_HorizonOrder.end());
+
+	m_HorizonBuffer.Clear(camera_position);
+	for (const auto& [distance_squared, j] : m_HorizonOrder)
+	{
+		const glm::vec3 min(m_ChunkBounds.min_x[j], m_ChunkBounds.min_y[j], m_ChunkBounds.min_z[j]);
+		const glm::vec3 max(m_ChunkBounds.max_x[j], m_ChunkBounds.max_y[j], m_ChunkBounds.max_z[j]);
+		if (m_FrustumVisibility[j] && m_HorizonBuffer.IsBelowHorizon(min, max)) {
+			m_FrustumVisibility[j] = 0;
+			m_HorizonCulledChunks++;
+		}
+
+		//Hidden chunks still hide what is behind them
+		const ChunkRenderRecord& record = packet.chunks[m_BoundedChunks[j]];
+		if (record.solid_height >= 0)
+			m_HorizonBuffer.AddOccluder(min + glm::vec3(0.5f), max - glm::vec3(0.5f), static_cast<f32>(record.solid_height));
+	}
+
+	m_HorizonMilliseconds = timer.GetElapsedMilliseconds();
+}
+
+void World::CullUnreachableChunks(const RenderPacket& packet, const glm::vec3& camera_position)
+{
+	Utils::Timer timer;
+	timer.StartTimer();
+
+	const s32 camera_section = static_cast<s32>(std::floor((camera_position.y + 0.5f) / Chunk::s_ChunkWidthAndHeight));
+	const glm::ivec2 camera_coords(glm::floor(glm::vec2(camera_position.x + 0.5f, camera_position.z + 0.5f) / static_cast<f32>(Chunk::s_ChunkWidthAndHeight)));
+
+	m_BoundedLookup.clear();
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+		m_BoundedLookup[RegistryKey(packet.chunks[m_BoundedChunks[j]].chunk_coords)] = j;
+
+	//Nothing can be culled from outside of the sections
+	auto start = m_BoundedLookup.find(RegistryKey(camera_coords));
+	if (start == m_BoundedLookup.end() || camera_section < 0 || camera_section >= static_cast<s32>(Chunk::s_SectionCount))
+		return;
+
+	m_ReachedSections.assign(m_BoundedChunks.size(), 0);
+	m_CaveQueue.clear();
+	m_CaveQueue.push_back({ start->second, static_cast<u8>(camera_section), CaveStep::s_NoFace, 0 });
+	m_ReachedSections[start->second] |= 1u << camera_section;
+
+	//Breadth first visit through the connected faces of the sections, never moving back toward the camera
+	for (u32 head = 0; head < m_CaveQueue.size(); head++)
+	{
+		const CaveStep step = m_CaveQueue[head];
+		const ChunkRenderRecord& record = packet.chunks[m_BoundedChunks[step.bounded_index]];
+		const std::array<u8, 6>& connectivity = record.connectivity[step.section];
+
+		for (u32 normal = 0; normal < 6; normal++)
+		{
+			if (step.directions & (1 << (normal ^ 1)))
+				continue;
+			if (step.entry_face != CaveStep::s_NoFace && !(connectivity[step.entry_face] & (1 << normal)))
+				continue;
+
+			const glm::ivec3 offset(Block::NormalForIndex(normal));
+			const s32 section = step.section + offset.y;
+			if (section < 0 || section >= static_cast<s32>(Chunk::s_SectionCount))
+				continue;
+
+			u32 bounded_index = step.bounded_index;
+			if (offset.x != 0 || offset.z != 0) {
+				auto iter = m_BoundedLookup.find(RegistryKey(record.chunk_coords + glm::ivec2(offset.x, offset.z)));
+				if (iter == m_BoundedLookup.end())
+					continue;
+				bounded_index = iter->second;
+			}
+
+			if (m_ReachedSections[bounded_index] & (1u << section))
+				continue;
+			m_ReachedSections[bounded_index] |= 1u << section;
+			m_CaveQueue.push_back({ bounded_index, static_cast<u8>(section), static_cast<u8>(normal ^ 1), static_cast<u8>(step.directions | (1 << normal)) });
+		}
+	}
+
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+	{
+		if (m_FrustumVisibility[j] && !m_ReachedSections[j]) {
+			m_FrustumVisibility[j] = 0;
+			m_CaveCulledChunks++;
+		}
+	}
+
+	m_CaveMilliseconds = timer.GetElapsedMilliseconds();
+}
+
+void World::CullOccludedChunks(const RenderPacket& packet, const glm::mat4& view_proj, const glm::vec3& camera_position)
+{
+	Utils::Timer timer;
+	timer.StartTimer();
+
+	//The nearest chunks in the frustum are the occluders, they hide most of the terrain behind them.
+	//Their boxes were recorded in the packet
+	m_OccluderCandidates.clear();
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+	{
+		if (!m_FrustumVisibility[j] || packet.chunks[m_BoundedChunks[j]].occluder_count == 0)
+			continue;
+
+		const glm::vec3 center = glm::vec3(m_ChunkBounds.min_x[j] + m_ChunkBounds.max_x[j], 0.0f, m_ChunkBounds.min_z[j] + m_ChunkBounds.max_z[j]) * 0.5f;
+		const glm::vec2 offset(center.x - camera_position.x, center.z - camera_position.z);
+		const f32 distance_squared = glm::dot(offset, offset);
+		if (distance_squared < s_OccluderDistance * s_OccluderDistance)
+			m_OccluderCandidates.emplace_back(distance_squared, j);
+	}
+
+	const u32 occluder_count = std::min(static_cast<u32>(m_OccluderCandidates.size()), s_MaxOccluderChunks);
+	std::partial_sort(m_OccluderCandidates.begin(), m_OccluderCandidates.begin() + occluder_count, m_OccluderCandidates.end());
+
+	m_OccluderBoxes.Clear();
+	const Culling::BoundsBatch& boxes = packet.occluders;
+	for (u32 k = 0; k < occluder_count; k++)
+	{
+		const ChunkRenderRecord& record = packet.chunks[m_BoundedChunks[m_OccluderCandidates[k].second]];
+		for (u32 b = record.first_occluder; b < record.first_occluder + record.occluder_count; b++)
+			m_OccluderBoxes.Push(glm::vec3(boxes.min_x[b], boxes.min_y[b], boxes.min_z[b]), glm::vec3(boxes.max_x[b], boxes.max_y[b], boxes.max_z[b]));
+	}
+
+	m_OcclusionBuffer.Clear(view_proj, camera_position);
+	for (u32 k = 0; k < m_OccluderBoxes.Size(); k++)
+		m_OcclusionBuffer.RasterizeBox(
+			glm::vec3(m_OccluderBoxes.min_x[k], m_OccluderBoxes.min_y[k], m_OccluderBoxes.min_z[k]),
+			glm::vec3(m_OccluderBoxes.max_x[k], m_OccluderBoxes.max_y[k], m_OccluderBoxes.max_z[k]));
+	m_OcclusionBuffer.BuildHiZ();
+
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+	{
+		if (!m_FrustumVisibility[j])
+			continue;
+
+		const glm::vec3 min(m_ChunkBounds.min_x[j], m_ChunkBounds.min_y[j], m_ChunkBounds.min_z[j]);
+		const glm::vec3 max(m_ChunkBounds.max_x[j], m_ChunkBounds.max_y[j], m_ChunkBounds.max_z[j]);
+		if (m_OcclusionBuffer.IsOccluded(min, max)) {
+			m_FrustumVisibility[j] = 0;
+			m_OccludedChunks++;
+		}
+	}
+
+	m_OcclusionMilliseconds = timer.GetElapsedMilliseconds();
+}
+
+void World::PublishVisibility(u32 buffer_index)
+{
+	std::lock_guard<std::mutex> lock{ m_VisibilityMutex };
+	m_PublishedVisibility = buffer_index;
+}
+
+void World::AcquireVisibility()
+{
+	std::lock_guard<std::mutex> lock{ m_VisibilityMutex };
+	const VisibilitySet& published = m_VisibilitySets[m_PublishedVisibility];
+	if (published.frame == m_LogicVisibility.frame)
+		return;
+
+	m_LogicVisibility.frame = published.frame;
+	m_LogicVisibility.chunks.assign(published.chunks.begin(), published.chunks.end());
+}
+
+u32 World::TestedChunks() const
+{
+	return m_TestedChunks;
+}
+
+u32 World::FrustumCulledChunks() const
+{
+	return m_FrustumCulledChunks;
+}
+
+u32 World::HorizonCulledChunks() const
+{
+	return m_HorizonCulledChunks;
+}
+
+f32 World::HorizonMilliseconds() const
+{
+	return m_HorizonMilliseconds;
+}
+
+u32 World::CaveCulledChunks() const
+{
+	return m_CaveCulledChunks;
+}
+
+f32 World::CaveMilliseconds() const
+{
+	return m_CaveMilliseconds;
+}
+
+u32 World::OccludedChunks() const
+{
+	return m_OccludedChunks;
+}
+
+f32 World::OcclusionMilliseconds() const
+{
+	return m_OcclusionMilliseconds;
+}
+
+u32 World::RenderedWaterRects() const
+{
+	return m_RenderedWaterRects;
+}
+
+u32 World::DropCount() const
+{
+	return m_Drops.Size();
+}
+
+u32 World::RenderedDrops() const
+{
+	return m_RenderedDrops;
+}
+
+f32 World::ShadedSamplesPerPixel() const
+{
+	return static_cast<f32>(m_SceneSamples.LastSamples()) / static_cast<f32>(Defs::g_ScreenWidth * Defs::g_ScreenHeight);
 }
 
-WorldEvent World::UpdateScene(Inventory& inventory, f32 elapsed_time)
+void World::SortFrontToBack(const RenderPacket& packet, const glm::vec3& camera_position, Utils::Vector<u32>& visible_chunks)
+{
+	//Every packet lists the chunks in its own order, so they are matched through their coordinates
+	m_DrawLookup.clear();
+	for (u32 j = 0; j < m_BoundedChunks.size(); j++)
+		if (m_FrustumVisibility[j])
+			m_DrawLookup[RegistryKey(packet.chunks[m_BoundedChunks[j]].chunk_coords)] = j;
+
+	//Distance from the nearest point of the bounds, so that tall and flat chunks compare fairly
+	auto squared_distance = [&](u32 j) {
+		const glm::vec3 min(m_ChunkBounds.min_x[j], m_ChunkBounds.min_y[j], m_ChunkBounds.min_z[j]);
+		const glm::vec3 max(m_ChunkBounds.max_x[j], m_ChunkBounds.max_y[j], m_ChunkBounds.max_z[j]);
+		const glm::vec3 offset = glm::clamp(camera_position, min, max) - camera_position;
+		return glm::dot(offset, offset);
+	};
+
+	//The chunks still visible keep their previous place, the new ones are appended
+	u32 kept = 0;
+	for (u32 k = 0; k < m_DrawOrder.size(); k++)
+	{
+		const u64 key = m_DrawOrder[k].key;
+		auto iter = m_DrawLookup.find(key);
+		if (iter == m_DrawLookup.end() || iter->second == s_NotDrawn)
+			continue;
+
+		m_DrawOrder[kept++] = { squared_distance(iter->second), key, iter->second };
+		iter->second = s_NotDrawn;
+	}
+	m_DrawOrder.resize(kept);
+	for (auto& [key, j] : m_DrawLookup)
+		if (j != s_NotDrawn)
+			m_DrawOrder.push_back({ squared_distance(j), key, j });
+
+	//Distances change little between frames, insertion sort is then close to linear.
+	//Many new chunks (turning around, teleporting) are sorted from scratch
+	auto nearer = [](const DrawOrderEntry& a, const DrawOrderEntry& b) { return a.distance_squared < b.distance_squared; };
+	if (m_DrawOrder.size() - kept > s_MaxInsertedChunks)
+	{
+		std::sort(m_DrawOrder.begin(), m_DrawOrder.end(), nearer);
+	}
+	else
+	{
+		for (u32 k = 1; k < m_DrawOrder.size(); k++)
+		{
+			const DrawOrderEntry entry = m_DrawOrder[k];
+			u32 l = k;
+			for (; l > 0 && nearer(entry, m_DrawOrder[l - 1]); l--)
+				m_DrawOrder[l] = m_DrawOrder[l - 1];
+			m_DrawOrder[l] = entry;
+		}
+	}
+
+	visible_chunks.clear();
+	for (const DrawOrderEntry& entry : m_DrawOrder)
+		visible_chunks.push_back(entry.bounded_index);
+}
+
+WorldEvent World::UpdateScene(Inventory& inventory, const glm::vec3& camera_position, const glm::vec3& camera_direction, f32 elapsed_time)
 {
 	//Chunk dynamic spawning
-	auto& camera_position = m_State.camera->GetPosition();
-	auto& camera_direction = m_State.camera->GetFront();
 	glm::vec2 camera_2d(camera_position.x, camera_position.z);
 	
 	if (!GlCore::g_SerializationRunning)
@@ -229,6 +797,7 @@ WorldEvent World::UpdateScene(Inventory& inventory, f32 elapsed_time)
 				//Generate new chunk
 				Pointer<Chunk> chunk_addr = Memory::New<Chunk>(m_State.memory_arena, *this, chunk_pos);
 				m_Chunks.push_back(chunk_addr);
+				RegisterChunk(chunk_addr);
 				Chunk* this_chunk = Memory::Get<Chunk>(m_State.memory_arena, chunk_addr);
 				HandleSectionData();
 
@@ -289,21 +858,29 @@ WorldEvent World::UpdateScene(Inventory& inventory, f32 elapsed_time)
 
 	}
 
+	//Bulk edit benchmark, the sphere is carved a bit in front of the player
+	const bool benchmark_key = m_State.game_window->IsKeyPressed(GLFW_KEY_B);
+	if (benchmark_key && !m_BenchmarkKeyDown)
+		BenchmarkSphereCarve(camera_position + camera_direction * 40.0f);
+	m_BenchmarkKeyDown = benchmark_key;
+
+	//Selection and block updates work on the chunks drawn by the last rendered frame
+	AcquireVisibility();
+
 	//Determine selection
 	WorldEvent world_event = HandleSelection(inventory, camera_position, camera_direction);
 
-	//normal updating & player collision
-	for (u32 i = 0; i < m_Chunks.size(); i++)
-	{
-		Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
-		if (!chunk)
-			break;
-		if (!chunk->IsChunkRenderable(camera_position) || !chunk->IsChunkVisible(camera_position, camera_direction))
-			continue;
+	//Done because the actual player is the head position, we want to grab the drops when we step on them
+	m_Drops.Update(*this, elapsed_time);
+	m_Drops.Pickup(camera_position - glm::vec3(0.0f, 1.0f, 0.0f), inventory);
 
-		//We update blocks drawing conditions only if we move or if we break blocks
-		chunk->UpdateBlocks(inventory, elapsed_time);
-	}
+	//Collision is solved next to the chunks, the render thread applies it with the packet
+	Physics::Collision collision;
+	if (Defs::g_ViewMode != Defs::ViewMode::Inventory)
+		collision = CheckPlayerCollision(camera_position, camera_direction, elapsed_time);
+
+	//Everything the render thread draws until the next update
+	RecordRenderPacket(camera_position, collision);
 
 	if constexpr (GlCore::g_MultithreadedRendering)
 		if (GlCore::g_SerializationRunning)
@@ -378,7 +955,7 @@ WorldEvent World::HandleSelection(Inventory& inventory, const glm::vec3& camera_
 
 	f32 nearest_distance = INFINITY;
 	Defs::HitDirection hit = Defs::HitDirection::None;
-	s32 involved_chunk = static_cast<u32>(-1);
+	Chunk* involved_chunk = nullptr;
 
 	auto window = m_State.game_window;
 
@@ -386,12 +963,11 @@ WorldEvent World::HandleSelection(Inventory& inventory, const glm::vec3& camera_
 	bool left_click = window->IsKeyPressed(GLFW_MOUSE_BUTTON_1);
 	bool right_click = window->IsKeyPressed(GLFW_MOUSE_BUTTON_2);
 
-	for (u32 i = 0; i < m_Chunks.size(); i++)
+	for (const glm::ivec2& chunk_coords : m_LogicVisibility.chunks)
 	{
-		Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
+		//The chunk can have been unloaded since the frame was drawn
+		Chunk* chunk = ChunkAt(chunk_coords);
 		if (!chunk)
-			break;
-		if (!chunk->IsChunkRenderable(camera_position) || !chunk->IsChunkVisible(camera_position, camera_direction))
 			continue;
 
 		const auto [hit_distance, hit_direction] = chunk->RayCollisionLogic(camera_position, camera_direction);
@@ -399,15 +975,15 @@ WorldEvent World::HandleSelection(Inventory& inventory, const glm::vec3& camera_
 		{
 			nearest_distance = hit_distance;
 			hit = hit_direction;
-			involved_chunk = i;
+			involved_chunk = chunk;
 		}
 	}
 
 	//Setting from which chunk the selectedd block comes from
-	Defs::g_SelectedChunk = involved_chunk;
-	if (involved_chunk != static_cast<u32>(-1))
+	m_SelectedChunk = involved_chunk;
+	if (involved_chunk)
 	{
-		Chunk* local_chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[involved_chunk]);
+		Chunk* local_chunk = involved_chunk;
 		Defs::g_SelectedBlock = local_chunk->LastSelectedBlock();
 		if (Defs::g_ViewMode != Defs::ViewMode::Inventory && (left_click || right_click)) 
 		{
@@ -419,42 +995,11 @@ WorldEvent World::HandleSelection(Inventory& inventory, const glm::vec3& camera_
 				const glm::vec3 position = local_chunk->ToWorld(raw_position);
 				const Defs::Item type = blocks[selected_block].Type();
 
-				blocks.erase(blocks.begin() + selected_block);
-
-				Pointer<Chunk> chunk_plus_x = GetChunk(IsChunk(*local_chunk, Defs::ChunkLocation::PlusX).value());
-				Pointer<Chunk> chunk_minus_x = GetChunk(IsChunk(*local_chunk, Defs::ChunkLocation::MinusX).value());
-				Pointer<Chunk> chunk_plus_z = GetChunk(IsChunk(*local_chunk, Defs::ChunkLocation::PlusZ).value());
-				Pointer<Chunk> chunk_minus_z = GetChunk(IsChunk(*local_chunk, Defs::ChunkLocation::MinusZ).value());
-
-				if (local_chunk->lower_threshold == position.y - 1.0f) {
-					local_chunk->EmplaceLowerBlockStack(1);
-				}
-
-				//The same thing could happen while deleting blocks from other chunks
-				f32 block_stack_size = 7.0f;
-				if (chunk_plus_x->lower_threshold - 1 >= position.y && raw_position.x == 15) {
-					u16 stack_count = static_cast<u16>(glm::ceil(static_cast<f32>(chunk_plus_x->lower_threshold - position.y) / block_stack_size));
-					chunk_plus_x->EmplaceLowerBlockStack(stack_count);
-				}
-				if (chunk_minus_x->lower_threshold - 1 >= position.y && raw_position.x == 0) {
-					u16 stack_count = static_cast<u16>(glm::ceil(static_cast<f32>(chunk_minus_x->lower_threshold - position.y) / block_stack_size));
-					chunk_minus_x->EmplaceLowerBlockStack(stack_count);
-				}
-				if (chunk_plus_z->lower_threshold - 1 >= position.y && raw_position.z == 15) {
-					u16 stack_count = static_cast<u16>(glm::ceil(static_cast<f32>(chunk_plus_z->lower_threshold - position.y) / block_stack_size));
-					chunk_plus_z->EmplaceLowerBlockStack(stack_count);
-				}
-				if (chunk_minus_z->lower_threshold - 1 >= position.y && raw_position.z == 0) {
-					u16 stack_count = static_cast<u16>(glm::ceil(static_cast<f32>(chunk_minus_z->lower_threshold - position.y) / block_stack_size));
-					chunk_minus_z->EmplaceLowerBlockStack(stack_count);
-				}
-
-				local_chunk->AddNewExposedNormals(position);
-				local_chunk->PushDrop(position, type);
+				local_chunk->BreakBlock(glm::ivec3(raw_position));
+				m_Drops.Push(position, type);
 
 				//Do this, it's pointless to compute block placement in the same frame
 				//of block destruction
-				Defs::g_EnvironmentChange = true;
 				return world_event;
 			}
 
@@ -480,94 +1025,34 @@ WorldEvent World::HandleSelection(Inventory& inventory, const glm::vec3& camera_
 					return world_event;
 				}
 
-				entry.value().item_count--;
-				inventory.ClearUsedSlots();
-				bool block_added_to_side_chunk = false;
+				glm::ivec3 target_position(local_chunk->ToWorld(block.position));
 				switch (hit)
 				{
-				case Defs::HitDirection::PosX: {
-					if (block.position.x == Chunk::s_ChunkWidthAndHeight - 1) {
-						std::optional<u32> adjacent_chunk_index = local_chunk->GetLoadedChunk(Defs::ChunkLocation::PlusX);
-						MC_ASSERT(adjacent_chunk_index.has_value(), "Error, this chunk should exist");
-						Pointer<Chunk> adjacent_chunk = GetChunk(adjacent_chunk_index.value());
-						auto& emplaced_block = adjacent_chunk->chunk_blocks.emplace_back(glm::u8vec3{ 0, block.position.y, block.position.z }, bt);
-						adjacent_chunk->AddFreshNormals(emplaced_block);
-						block_added_to_side_chunk = true;
-					}
-					else {
-						//NOTE: the block is just emplaced at the top of the vector
-						//without caring to place it at the top of the respective xz column
-						//does not seem to be a problem at the moment but a proper insertion
-						//could be useful to keep the chunk more integral
-						blocks.emplace_back(block.position + glm::u8vec3(1,0,0), bt);
-					}
-
-				} break;
-				case Defs::HitDirection::NegX: {
-					if (block.position.x == 0) {
-						//The chunk is adjacent to the chunk we are in, should definitely be loaded
-						std::optional<u32> adjacent_chunk_index = local_chunk->GetLoadedChunk(Defs::ChunkLocation::MinusX);
-						MC_ASSERT(adjacent_chunk_index.has_value(), "Error, this chunk should exist");
-						Pointer<Chunk> adjacent_chunk = GetChunk(adjacent_chunk_index.value());
-						auto& emplaced_block = adjacent_chunk->chunk_blocks.emplace_back(glm::u8vec3{ Chunk::s_ChunkWidthAndHeight - 1, block.position.y, block.position.z}, bt);
-						adjacent_chunk->AddFreshNormals(emplaced_block);
-						block_added_to_side_chunk = true;
-					}
-					else {
-						blocks.emplace_back(block.position + glm::u8vec3(-1, 0, 0), bt);
-					}
-				} break;
-				case Defs::HitDirection::PosY:
-					blocks.emplace_back(block.position + glm::u8vec3(0, 1, 0), bt);
-					break;
-				case Defs::HitDirection::NegY:
-					blocks.emplace_back(block.position + glm::u8vec3(0, -1, 0), bt);
-					break;
-				case Defs::HitDirection::PosZ: {
-					if (block.position.z == Chunk::s_ChunkWidthAndHeight - 1) {
-						std::optional<u32> adjacent_chunk_index = local_chunk->GetLoadedChunk(Defs::ChunkLocation::PlusZ);
-						MC_ASSERT(adjacent_chunk_index.has_value(), "Error, this chunk should exist");
-						Pointer<Chunk> adjacent_chunk = GetChunk(adjacent_chunk_index.value());
-						auto& emplaced_block = adjacent_chunk->chunk_blocks.emplace_back(glm::u8vec3{ block.position.x, block.position.y, 0 }, bt);
-						adjacent_chunk->AddFreshNormals(emplaced_block);
-						block_added_to_side_chunk = true;
-					}
-					else {
-						blocks.emplace_back(block.position + glm::u8vec3(0, 0, 1), bt);
-					}
-					
-				} break;
-				case Defs::HitDirection::NegZ: {
-					if (block.position.z == 0) {
-						//The chunk is adjacent to the chunk we are in, should definitely be loaded
-						std::optional<u32> adjacent_chunk_index = local_chunk->GetLoadedChunk(Defs::ChunkLocation::MinusZ);
-						MC_ASSERT(adjacent_chunk_index.has_value(), "Error, this chunk should exist");
-						Pointer<Chunk> adjacent_chunk = GetChunk(adjacent_chunk_index.value());
-						auto& emplaced_block = adjacent_chunk->chunk_blocks.emplace_back(glm::u8vec3{ block.position.x, block.position.y, Chunk::s_ChunkWidthAndHeight - 1 }, bt);
-						adjacent_chunk->AddFreshNormals(emplaced_block);
-						block_added_to_side_chunk = true;
-					}
-					else {
-						blocks.emplace_back(block.position + glm::u8vec3(0, 0, -1), bt);
-					}
-				} break;
-
+				case Defs::HitDirection::PosX: target_position.x++; break;
+				case Defs::HitDirection::NegX: target_position.x--; break;
+				case Defs::HitDirection::PosY: target_position.y++; break;
+				case Defs::HitDirection::NegY: target_position.y--; break;
+				case Defs::HitDirection::PosZ: target_position.z++; break;
+				case Defs::HitDirection::NegZ: target_position.z--; break;
 				case Defs::HitDirection::None:
 					MC_ASSERT(false, "Unreachable");
 					break;
 				}
 
-				if(!block_added_to_side_chunk)
-					local_chunk->AddFreshNormals(blocks.back());
+				//The target can be in one of the adjacent chunks
+				if (!SetBlock(target_position, bt))
+					return world_event;
+
+				entry.value().item_count--;
+				inventory.ClearUsedSlots();
 			}
-			Defs::g_EnvironmentChange = true;
 		}
 	}
 
 	return world_event;
 }
 
-void World::CheckPlayerCollision(const glm::vec3& position, f32 elapsed_time)
+Physics::Collision World::CheckPlayerCollision(const glm::vec3& position, const glm::vec3& camera_direction, f32 elapsed_time)
 {
 	u16 count = 0;
 	Chunk** chunk_buffer = Memory::Get<Chunk*>(m_State.memory_arena, m_CollisionChunkBuffer);
@@ -580,7 +1065,8 @@ void World::CheckPlayerCollision(const glm::vec3& position, f32 elapsed_time)
 			chunk_buffer[count++] = chunk;
 	}
 
-	Camera* cam = m_State.camera;
+	Physics::Collision collision;
+	glm::vec3 corrected_position = position;
 
 	//Give a starting point to every null coord if necessary
 
@@ -595,15 +1081,17 @@ void World::CheckPlayerCollision(const glm::vec3& position, f32 elapsed_time)
 	//Offset the position by a factor multiplied by the elapsed time. This makes it so that
 	//when there is a particularly long frame, the collision calculations can still be pretty
 	//accurate
-	glm::vec3 dir = cam->GetFront() * (glm::vec3(fw + fs, 0.0f, fa + fd) * elapsed_time);
-	cam->position += dir;
+	glm::vec3 dir = camera_direction * (glm::vec3(fw + fs, 0.0f, fa + fd) * elapsed_time);
+	corrected_position += dir;
 	for (u16 i = 0; i < count; i++) {
-		if (chunk_buffer[i]->BlockCollisionLogic(cam->position))
+		if (chunk_buffer[i]->BlockCollisionLogic(corrected_position, collision))
 			xz_collision_happened = true;
 	}
 
 	if(!xz_collision_happened)
-		cam->position -= dir;
+		corrected_position -= dir;
+	collision.correction = corrected_position - position;
+	return collision;
 }
 
 void World::HandleSectionData()
@@ -625,34 +1113,282 @@ void World::HandleSectionData()
 
 std::optional<u32> World::IsChunk(const Chunk& chunk, const Defs::ChunkLocation& cl)
 {
-	const glm::vec2& origin = chunk.ChunkOrigin2D();
-	static auto find_alg = [&](const glm::vec2& pos) ->std::optional<u32>
+	glm::ivec2 offset(0);
+	switch (cl)
 	{
-		for (u32 i = 0; i < m_Chunks.size(); i++)
+	case Defs::ChunkLocation::PlusX:
+		offset.x = 1;
+		break;
+	case Defs::ChunkLocation::MinusX:
+		offset.x = -1;
+		break;
+	case Defs::ChunkLocation::PlusZ:
+		offset.y = 1;
+		break;
+	case Defs::ChunkLocation::MinusZ:
+		offset.y = -1;
+		break;
+	default:
+		return std::nullopt;
+	}
+
+	Chunk* side_chunk = ChunkAt(chunk.ChunkCoords() + offset);
+	return side_chunk ? std::make_optional(side_chunk->Index()) : std::nullopt;
+}
+
+Chunk* World::ChunkAt(const glm::ivec2& chunk_coords)
+{
+	Pointer<Chunk> chunk_addr;
+	{
+		std::lock_guard<std::mutex> lock(m_RegistryMutex);
+		auto iter = m_ChunkRegistry.find(RegistryKey(chunk_coords));
+		if (iter == m_ChunkRegistry.end())
+			return nullptr;
+
+		chunk_addr = iter->second;
+	}
+
+	return Memory::Get<Chunk>(m_State.memory_arena, chunk_addr);
+}
+
+std::optional<s32> World::ColumnHeight(f32 x, f32 z)
+{
+	//Blocks are centered on their integer position
+	glm::ivec2 chunk_coords;
+	const glm::ivec3 local_pos = ToChunkSpace(glm::ivec3(std::roundf(x), 0, std::roundf(z)), chunk_coords);
+
+	Chunk* chunk = ChunkAt(chunk_coords);
+	if (!chunk)
+		return std::nullopt;
+
+	return chunk->ColumnHeight(local_pos.x, local_pos.z);
+}
+
+std::optional<Defs::Item> World::GetBlock(const glm::ivec3& world_pos)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	Chunk* chunk = ResolveBlock(world_pos, local_pos, cursor);
+	return chunk ? chunk->BlockTypeAt(local_pos) : std::nullopt;
+}
+
+bool World::SetBlock(const glm::ivec3& world_pos, Defs::Item type)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	Chunk* chunk = ResolveBlock(world_pos, local_pos, cursor);
+	return chunk && chunk->PlaceBlock(local_pos, type);
+}
+
+std::optional<Defs::Item> World::RemoveBlock(const glm::ivec3& world_pos)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	Chunk* chunk = ResolveBlock(world_pos, local_pos, cursor);
+	return chunk ? chunk->BreakBlock(local_pos) : std::nullopt;
+}
+
+void World::GetBlocks(const glm::ivec3* positions, u32 count, std::optional<Defs::Item>* out_types)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	for (u32 i = 0; i < count; i++)
+	{
+		Chunk* chunk = ResolveBlock(positions[i], local_pos, cursor);
+		out_types[i] = chunk ? chunk->BlockTypeAt(local_pos) : std::nullopt;
+	}
+}
+
+u32 World::SetBlocks(const glm::ivec3* positions, const Defs::Item* types, u32 count)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	u32 placed = 0;
+	for (u32 i = 0; i < count; i++)
+	{
+		Chunk* chunk = ResolveBlock(positions[i], local_pos, cursor);
+		if (chunk && chunk->PlaceBlock(local_pos, types[i]))
+			placed++;
+	}
+
+	return placed;
+}
+
+u32 World::RemoveBlocks(const glm::ivec3* positions, u32 count)
+{
+	ChunkCursor cursor;
+	glm::ivec3 local_pos;
+	u32 removed = 0;
+	for (u32 i = 0; i < count; i++)
+	{
+		Chunk* chunk = ResolveBlock(positions[i], local_pos, cursor);
+		if (chunk && chunk->BreakBlock(local_pos).has_value())
+			removed++;
+	}
+
+	return removed;
+}
+
+u32 World::EditRegion(const Defs::RegionEdit& edit)
+{
+	//Chunks could be leaving m_Chunks right now
+	if (GlCore::g_SerializationRunning)
+		return 0;
+
+	//Chunks next to the region are included, their border faces or underground can change too
+	glm::ivec2 min_coords, max_coords;
+	ToChunkSpace(edit.min - glm::ivec3(1), min_coords);
+	ToChunkSpace(edit.max + glm::ivec3(1), max_coords);
+
+	const s32 side = static_cast<s32>(Chunk::s_ChunkWidthAndHeight);
+	Utils::Vector<Chunk*> touched_chunks, edited_chunks;
+	for (s32 x = min_coords.x; x <= max_coords.x; x++)
+	{
+		for (s32 z = min_coords.y; z <= max_coords.y; z++)
 		{
-			Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, m_Chunks[i]);
+			Chunk* chunk = ChunkAt(glm::ivec2(x, z));
 			if (!chunk)
-				break;
-			if (chunk->ChunkOrigin2D() == pos)
-				return chunk->Index();
+				continue;
+
+			touched_chunks.push_back(chunk);
+			const glm::ivec3 origin(chunk->ChunkOrigin3D());
+			if (edit.max.x >= origin.x && edit.min.x < origin.x + side &&
+				edit.max.z >= origin.z && edit.min.z < origin.z + side)
+				edited_chunks.push_back(chunk);
 		}
+	}
 
-		return std::nullopt;
-	};
+	std::atomic<u32> edited_count = 0;
+	m_Workers.ParallelFor(edited_chunks.size(), [&](u32 i) { edited_count += edited_chunks[i]->ApplyRegionEdit(edit); });
+	if (edited_count == 0)
+		return 0;
 
-	switch (cl)
+	//Every cell write is done, the chunks can now read each other safely
+	Utils::Vector<Utils::Vector<glm::ivec3>> exposed_cells(touched_chunks.size());
+	m_Workers.ParallelFor(touched_chunks.size(), [&](u32 i) { touched_chunks[i]->CollectExposedCells(edit, exposed_cells[i]); });
+	m_Workers.ParallelFor(touched_chunks.size(), [&](u32 i)
+		{
+			for (const glm::ivec3& local_pos : exposed_cells[i])
+				touched_chunks[i]->MaterializeCell(local_pos);
+		});
+	m_Workers.ParallelFor(touched_chunks.size(), [&](u32 i) { touched_chunks[i]->RebuildFaces(); });
+	return edited_count;
+}
+
+u32 World::FillBox(const glm::ivec3& min, const glm::ivec3& max, Defs::Item type)
+{
+	Defs::RegionEdit edit{};
+	edit.shape = Defs::EditShape::Box;
+	edit.operation = Defs::EditOperation::Fill;
+	edit.min = min;
+	edit.max = max;
+	edit.type = type;
+	return EditRegion(edit);
+}
+
+u32 World::ReplaceBox(const glm::ivec3& min, const glm::ivec3& max, Defs::Item replaced_type, Defs::Item type)
+{
+	Defs::RegionEdit edit{};
+	edit.shape = Defs::EditShape::Box;
+	edit.operation = Defs::EditOperation::Replace;
+	edit.min = min;
+	edit.max = max;
+	edit.type = type;
+	edit.replaced_type = replaced_type;
+	return EditRegion(edit);
+}
+
+u32 World::ClearBox(const glm::ivec3& min, const glm::ivec3& max)
+{
+	Defs::RegionEdit edit{};
+	edit.shape = Defs::EditShape::Box;
+	edit.operation = Defs::EditOperation::Clear;
+	edit.min = min;
+	edit.max = max;
+	return EditRegion(edit);
+}
+
+u32 World::FillSphere(const glm::vec3& center, f32 radius, Defs::Item type)
+{
+	Defs::RegionEdit edit{};
+	edit.shape = Defs::EditShape::Sphere;
+	edit.operation = Defs::EditOperation::Fill;
+	edit.min = glm::ivec3(glm::floor(center - radius));
+	edit.max = glm::ivec3(glm::ceil(center + radius));
+	edit.center = center;
+	edit.radius = radius;
+	edit.type = type;
+	return EditRegion(edit);
+}
+
+u32 World::CarveSphere(const glm::vec3& center, f32 radius)
+{
+	Defs::RegionEdit edit{};
+	edit.shape = Defs::EditShape::Sphere;
+	edit.operation = Defs::EditOperation::Clear;
+	edit.min = glm::ivec3(glm::floor(center - radius));
+	edit.max = glm::ivec3(glm::ceil(center + radius));
+	edit.center = center;
+	edit.radius = radius;
+	return EditRegion(edit);
+}
+
+void World::BenchmarkSphereCarve(const glm::vec3& center)
+{
+	Utils::Timer timer;
+	timer.StartTimer();
+	u32 carved = CarveSphere(glm::round(center), 32.0f);
+	MC_CLOG("Sphere carve 64^3: %u blocks removed in %.3f ms\n", carved, timer.GetElapsedMilliseconds());
+}
+
+glm::ivec3 World::ToChunkSpace(const glm::ivec3& world_pos, glm::ivec2& chunk_coords)
+{
+	const s32 side = static_cast<s32>(Chunk::s_ChunkWidthAndHeight);
+	//Floor division, negative positions belong to the chunk on their left
+	chunk_coords.x = (world_pos.x >= 0 ? world_pos.x : world_pos.x - side + 1) / side;
+	chunk_coords.y = (world_pos.z >= 0 ? world_pos.z : world_pos.z - side + 1) / side;
+	return glm::ivec3(world_pos.x - chunk_coords.x * side, world_pos.y, world_pos.z - chunk_coords.y * side);
+}
+
+Chunk* World::ResolveBlock(const glm::ivec3& world_pos, glm::ivec3& local_pos, ChunkCursor& cursor)
+{
+	glm::ivec2 chunk_coords;
+	local_pos = ToChunkSpace(world_pos, chunk_coords);
+	if (!cursor.valid || cursor.coords != chunk_coords)
 	{
-	case Defs::ChunkLocation::PlusX:
-		return find_alg(origin + glm::vec2(16.0f, 0.0f));
-	case Defs::ChunkLocation::MinusX:
-		return find_alg(origin - glm::vec2(16.0f, 0.0f));
-	case Defs::ChunkLocation::PlusZ:
-		return find_alg(origin + glm::vec2(0.0f, 16.0f));
-	case Defs::ChunkLocation::MinusZ:
-		return find_alg(origin - glm::vec2(0.0f, 16.0f));
+		cursor.coords = chunk_coords;
+		cursor.chunk = ChunkAt(chunk_coords);
+		cursor.valid = true;
+	}
+
+	return cursor.chunk;
+}
+
+void World::RegisterChunk(Pointer<Chunk> chunk_addr)
+{
+	Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, chunk_addr);
+	{
+		std::lock_guard<std::mutex> lock(m_RegistryMutex);
+		m_ChunkRegistry[RegistryKey(chunk->ChunkCoords())] = chunk_addr;
 	}
 
-	return std::nullopt;
+	//The consumers resolve the events through the registry
+	chunk->StartPublishingChanges();
+}
+
+void World::UnregisterChunk(const Chunk& chunk)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_RegistryMutex);
+		m_ChunkRegistry.erase(RegistryKey(chunk.ChunkCoords()));
+	}
+
+	QueueMeshRelease(chunk);
+}
+
+u64 World::RegistryKey(const glm::ivec2& chunk_coords)
+{
+	return (static_cast<u64>(static_cast<u32>(chunk_coords.x)) << 32) | static_cast<u32>(chunk_coords.y);
 }
 
 Pointer<Chunk> World::GetChunk(u32 index)
@@ -676,8 +1412,6 @@ const Defs::WorldSeed& World::Seed() const
 
 void World::SerializeSector(u32 index)
 {
-	//Load sector's serializer
-	Utils::Serializer sz("runtime_files/sector_" + std::to_string(index) + Defs::g_SerializedFileFormat, "wb");
 	u32 serialized_chunks = 0;
 
 	//(When multithreading) Advertise the render thread m_Chunks 
@@ -697,6 +1431,7 @@ void World::SerializeSector(u32 index)
 		//Determine safe iteration range for the renderer thread
 		for (auto sub_iter = iter; sub_iter != m_Chunks.end(); ++sub_iter) {
 			removable_chunks[count++] = *sub_iter;
+			UnregisterChunk(*Memory::Get<Chunk>(m_State.memory_arena, *sub_iter));
 		}
 		
 		m_Chunks.erase(iter, m_Chunks.end());
@@ -708,20 +1443,61 @@ void World::SerializeSector(u32 index)
 	if (count == 0)
 		return;
 
-	//Number of chunks at the beginning (leave blank for now)
-	sz.Serialize<u32>(0);
-	for(u16 i = 0; i < count; i++)
+	//A sector loaded and never edited is already up to date on disk
+	if (IsSectorModified(index, removable_chunks, count))
+	{
+		//Load sector's serializer
+		Utils::Serializer sz("runtime_files/sector_" + std::to_string(index) + Defs::g_SerializedFileFormat, "wb");
+		sz& s_SectorFormatVersion;
+		//Number of chunks after the version (leave blank for now)
+		sz.Serialize<u32>(0);
+		for (u16 i = 0; i < count; i++)
+		{
+			Memory::Get<Chunk>(m_State.memory_arena, removable_chunks[i])->Serialize(sz);
+			serialized_chunks++;
+		}
+
+		//Write the amount of chunks serialized
+		sz.Seek(sizeof(u32));
+		sz& serialized_chunks;
+	}
+	else
+	{
+		MC_LOG("Sector {} unchanged since it was loaded\n", index);
+	}
+
+	for (u16 i = 0; i < count; i++)
 	{
-		Chunk* chunk = Memory::Get<Chunk>(m_State.memory_arena, removable_chunks[i]);
-		chunk->Serialize(sz);
 		Memory::UnlockRegion(m_State.memory_arena, removable_chunks[i]);
 		Memory::Delete<Chunk>(m_State.memory_arena, removable_chunks[i]);
-		serialized_chunks++;
 	}
+	m_ModifiedSectors.erase(index);
+}
+
+bool World::IsSectorModified(u32 index, const VAddr* chunks, u16 count)
+{
+	Changes::Event event;
+	while (m_IoChanges.Pop(event))
+		m_ModifiedSectors[event.sector_index]++;
+
+	//Lost events and edits made after the drain are still raised in the chunks themselves
+	m_IoChanges.ConsumeOverflow();
+	if (m_ModifiedSectors.find(index) != m_ModifiedSectors.end())
+		return true;
+
+	for (u16 i = 0; i < count; i++)
+		if (Memory::Get<Chunk>(m_State.memory_arena, chunks[i])->HasChange(Changes::Serialization))
+			return true;
+	return false;
+}
 
-	//Write the amount of chunks serialized
-	sz.Seek(0);
-	sz& serialized_chunks;
+void World::PublishChanges(const Chunk& chunk, u8 kinds)
+{
+	const Changes::Event event = { chunk.ChunkCoords(), chunk.SectorIndex(), kinds };
+	if (kinds & Changes::g_RenderKinds)
+		m_RenderChanges.Push(event);
+	if (kinds & Changes::Serialization)
+		m_IoChanges.Push(event);
 }
 
 void World::DeserializeSector(u32 index)
@@ -729,6 +1505,15 @@ void World::DeserializeSector(u32 index)
 	//Load sector's serializer
 	Utils::Serializer sz("runtime_files/sector_" + std::to_string(index) + Defs::g_SerializedFileFormat, "rb");
 
+	//Files written with another chunk layout cannot be read back, their chunks are not loaded
+	u32 version = 0;
+	sz% version;
+	if (version != s_SectorFormatVersion)
+	{
+		MC_LOG("Sector {} has format version {}, expected {}: discarded\n", index, version, s_SectorFormatVersion);
+		return;
+	}
+
 	if constexpr (GlCore::g_MultithreadedRendering)
 	{
 		for (u32 i = 0; i < m_Chunks.size(); i++)
@@ -746,8 +1531,10 @@ void World::DeserializeSector(u32 index)
 		sz% deser_size;
 	}
 
-	while (!sz.Eof())	
+	while (!sz.Eof()) {
 		m_Chunks.emplace_back(Memory::New<Chunk>(m_State.memory_arena, *this, sz, index));
+		RegisterChunk(m_Chunks.back());
+	}
 }
 
 bool World::IsPushable(const Chunk& chunk, const Defs::ChunkLocation& cl, const glm::vec3& vec)
@@ -4,10 +4,24 @@
 #include <thread>
 #include <future>
 #include <random>
+#include <mutex>
+#include <array>
 #include "Chunk.h"
+#include "Culling.h"
+#include "ChangeTracking.h"
+#include "RenderPacket.h"
 
 class Inventory;
 
+//Remembers the last chunk resolved by the batched voxel functions,
+//consecutive positions are usually in the same chunk
+struct ChunkCursor
+{
+    glm::ivec2 coords;
+    Chunk* chunk = nullptr;
+    bool valid = false;
+};
+
 //Some updates that happen in some world functions
 struct WorldEvent
 {
@@ -21,33 +35,150 @@ struct WorldEvent
     u8 unused6 : 1;
 };
 
+//Chunks which passed the culling of a frame, as chunk coordinates
+struct VisibilitySet
+{
+    u64 frame = 0;
+    Utils::Vector<glm::ivec2> chunks;
+};
+
+//Section reached by the cave culling visit
+struct CaveStep
+{
+    static constexpr u8 s_NoFace = 0xFF;
+
+    //Index of the chunk in the renderable chunks of the frame
+    u32 bounded_index;
+    u8 section;
+    //Face the section was entered from, s_NoFace for the camera section
+    u8 entry_face;
+    //Directions taken from the camera section up to here
+    u8 directions;
+};
+
 class World {
 public:
     World();
     ~World();
+    //Takes the last packet published by the logic thread and moves the player out of the blocks it
+    //collided with. Render thread only, called before the camera position of the frame is read
+    void AcquireRenderPacket();
     //Renders visible world
-    void Render(const Inventory& inventory, const glm::vec3& camera_position, const glm::vec3& camera_direction);
-    [[nodiscard]] WorldEvent UpdateScene(Inventory& inventory, f32 elapsed_time);
+    void Render(const Inventory& inventory, const glm::vec3& camera_position);
+    //The camera is passed as a copy taken before the update, the logic thread never reads the live one
+    [[nodiscard]] WorldEvent UpdateScene(Inventory& inventory, const glm::vec3& camera_position, const glm::vec3& camera_direction, f32 elapsed_time);
     [[nodiscard]] WorldEvent HandleSelection(Inventory& inventory, const glm::vec3& camera_position, const glm::vec3& camera_direction);
-    void CheckPlayerCollision(const glm::vec3& position, f32 elapsed_time);
     //Pushes setion data to eventually help with serialization
     void HandleSectionData();
+    //Block triangles drawn by the last scene pass
+    u32 RenderedTriangles() const;
+    //Renderable chunks tested against the frustum by the last scene pass, and how many were rejected
+    u32 TestedChunks() const;
+    u32 FrustumCulledChunks() const;
+    //Chunks in the frustum whose top is below the horizon of the nearer terrain
+    u32 HorizonCulledChunks() const;
+    f32 HorizonMilliseconds() const;
+    //Chunks in the frustum that cannot be seen through empty space from the camera section
+    u32 CaveCulledChunks() const;
+    f32 CaveMilliseconds() const;
+    //Chunks in the frustum hidden by the terrain in the last scene pass, and the time spent finding them
+    u32 OccludedChunks() const;
+    f32 OcclusionMilliseconds() const;
+    //Block samples shaded by the scene pass for each screen pixel, 1 means no overdraw. A few frames late
+    f32 ShadedSamplesPerPixel() const;
+    //Merged water rectangles drawn by the last scene pass
+    u32 RenderedWaterRects() const;
+    //Drops in the world, and how many passed the culling in the last scene pass
+    u32 DropCount() const;
+    u32 RenderedDrops() const;
 
     //Returns the corresponding chunk index if exists
     std::optional<u32> IsChunk(const Chunk& chunk, const Defs::ChunkLocation& cl);
     Pointer<Chunk> GetChunk(u32 index);
+    //O(1) access to a loaded chunk from its integer coordinates (origin / 16), nullptr if not loaded
+    Chunk* ChunkAt(const glm::ivec2& chunk_coords);
+    //Y of the highest solid block at the world column, nullopt if its chunk is not loaded
+    std::optional<s32> ColumnHeight(f32 x, f32 z);
+
+    //Voxel access in integer world coordinates, crossing chunk borders is handled internally.
+    //GetBlock returns nullopt for empty positions and for the ones in unloaded chunks
+    std::optional<Defs::Item> GetBlock(const glm::ivec3& world_pos);
+    //Returns false if the position is occupied or its chunk is not loaded
+    bool SetBlock(const glm::ivec3& world_pos, Defs::Item type);
+    //Returns the type of the removed block, nullopt if nothing was removed
+    std::optional<Defs::Item> RemoveBlock(const glm::ivec3& world_pos);
+    //Calls fn(neighbor_position, neighbor_type) for each of the 6 adjacent positions
+    template<class Fn> void ForEachNeighbor(const glm::ivec3& world_pos, Fn&& fn);
+
+    //Batched variants, they return how many positions were actually edited
+    void GetBlocks(const glm::ivec3* positions, u32 count, std::optional<Defs::Item>* out_types);
+    u32 SetBlocks(const glm::ivec3* positions, const Defs::Item* types, u32 count);
+    u32 RemoveBlocks(const glm::ivec3* positions, u32 count);
+
+    //Bulk edits, applied in parallel for each chunk with a single face rebuild at the end.
+    //They return how many blocks were changed
+    u32 EditRegion(const Defs::RegionEdit& edit);
+    u32 FillBox(const glm::ivec3& min, const glm::ivec3& max, Defs::Item type);
+    u32 ReplaceBox(const glm::ivec3& min, const glm::ivec3& max, Defs::Item replaced_type, Defs::Item type);
+    u32 ClearBox(const glm::ivec3& min, const glm::ivec3& max);
+    u32 FillSphere(const glm::vec3& center, f32 radius, Defs::Item type);
+    u32 CarveSphere(const glm::vec3& center, f32 radius);
+    //Carves a sphere 64 blocks wide and prints how long it took
+    void BenchmarkSphereCarve(const glm::vec3& center);
+
+    //Splits a world position into the coordinates of its chunk and the position inside it
+    static glm::ivec3 ToChunkSpace(const glm::ivec3& world_pos, glm::ivec2& chunk_coords);
 
     Defs::WorldSeed& Seed();
     const Defs::WorldSeed& Seed() const;
 
-    //Serialization utilities
+    //Serialization utilities, sector files start with s_SectorFormatVersion and the number of chunks.
+    //Bump the version whenever Chunk::Serialize changes layout, files of other versions are discarded
+    static constexpr u32 s_SectorFormatVersion = 2;
     void SerializeSector(u32 index);
     void DeserializeSector(u32 index);
+    //Called by the chunks when one of their change kinds is raised, from any thread
+    void PublishChanges(const Chunk& chunk, u8 kinds);
 
 private:
     //Function which handles spawnable chunk pushing conditions
     bool IsPushable(const Chunk& chunk, const Defs::ChunkLocation& cl, const glm::vec3& vec);
     glm::vec2 SectionCentralPosFrom(u32 index);
+    //Chunk registry handling, called whenever a chunk enters or leaves m_Chunks
+    void RegisterChunk(Pointer<Chunk> chunk_addr);
+    void UnregisterChunk(const Chunk& chunk);
+    static u64 RegistryKey(const glm::ivec2& chunk_coords);
+    //Resolves the owning chunk reusing the cursor when possible, nullptr if not loaded
+    Chunk* ResolveBlock(const glm::ivec3& world_pos, glm::ivec3& local_pos, ChunkCursor& cursor);
+    //Copies what the render thread needs from the chunks around the camera and publishes it. Logic thread only
+    void RecordRenderPacket(const glm::vec3& camera_position, const Physics::Collision& collision);
+    //Probes the player movement against the nearby blocks. Logic thread only, the camera and
+    //the movement state are updated by the render thread when it acquires the packet
+    Physics::Collision CheckPlayerCollision(const glm::vec3& position, const glm::vec3& camera_direction, f32 elapsed_time);
+    //Builds on worker threads the faces of the dirty chunks near the camera and queues them for the render thread
+    void RebuildChunkMeshes(const glm::vec3& camera_position, u64 sequence);
+    //Collects the chunks which need a rebuild, from the change events or from a full scan
+    void CollectDirtyChunks(const glm::vec3& camera_position, bool rescan, Utils::Vector<Chunk*>& dirty_chunks);
+    //Queues the release of the pool ranges of a chunk leaving the world, from any thread
+    void QueueMeshRelease(const Chunk& chunk);
+    //Applies the mesh updates recorded up to the packet being drawn. Render thread only
+    void ApplyMeshUpdates(u64 sequence);
+    //Drains the serialization events, true if the sector being unloaded differs from its file
+    bool IsSectorModified(u32 index, const VAddr* chunks, u16 count);
+    //Swaps in the set computed by the render thread for the frame being drawn
+    void PublishVisibility(u32 buffer_index);
+    //Tests the chunks against the horizon built front to back from the nearer ones
+    void CullBelowHorizon(const RenderPacket& packet, const glm::vec3& camera_position);
+    //Visits the sections connected to the camera one and clears the frustum visibility of the chunks never reached
+    void CullUnreachableChunks(const RenderPacket& packet, const glm::vec3& camera_position);
+    //Rasterizes the nearest chunks as occluders and clears the frustum visibility of the hidden ones
+    void CullOccludedChunks(const RenderPacket& packet, const glm::mat4& view_proj, const glm::vec3& camera_position);
+    //Writes the visible chunks front to back as indices in m_BoundedChunks, starting from the order of the previous frame
+    void SortFrontToBack(const RenderPacket& packet, const glm::vec3& camera_position, Utils::Vector<u32>& visible_chunks);
+    //Mesh drawn for a record of the packet, nullptr if none was applied yet
+    const ChunkMesh* FindMesh(const ChunkRenderRecord& record) const;
+    //Copies the last published set in m_LogicVisibility if it is newer. Logic thread only
+    void AcquireVisibility();
     
 public:
     //Keeps track of the generated terrain for each chunk, helps to optimize
@@ -67,12 +198,19 @@ private:
     //able to be flexible in multithreading. We just store a vistual address
     //in our virtual memory space
     Utils::Vector<Pointer<Chunk>> m_Chunks;
+    //Loaded chunks indexed by their coordinates, so that neighbors can be reached without
+    //scanning m_Chunks. Also accessed by the serialization thread, hence the mutex
+    Utils::UnorderedMap<u64, Pointer<Chunk>> m_ChunkRegistry;
+    std::mutex m_RegistryMutex;
 
     //Non existing chunk which are near existing ones. They can spawn if the
     //player gets near enough
     Utils::Vector<glm::vec3> m_SpawnableChunks;
-    //Last player pos, used to update the shadow texture
-    glm::vec3 m_LastPos;
+    //Every drop of the world, simulated by the logic thread and drawn by the render thread
+    DropStore m_Drops;
+    u32 m_RenderedDrops = 0;
+    //Shadow map tiles around the player, refreshed when they scroll into view or their chunks are rebuilt
+    GlCore::ShadowTiles m_ShadowTiles;
     //For terrain generation
     Defs::WorldSeed m_WorldSeed;
     //Handles section data
@@ -90,4 +228,110 @@ private:
 
     //Serialization threads
     std::future<void> m_SerializingFut;
-};
\ No newline at end of file
+    //Workers of the mesh rebuilds and of the region edits, both run by the logic thread
+    Utils::WorkerPool m_Workers;
+
+    //Change events published by the chunks. The mesh rebuild consumes the first queue, the serialization
+    //the second one. Events of chunks out of the rendering distance wait in m_PendingRebuilds, by registry key
+    static constexpr u32 s_ChangeQueueCapacity = 4096;
+    Changes::EventQueue m_RenderChanges{ s_ChangeQueueCapacity };
+    Changes::EventQueue m_IoChanges{ s_ChangeQueueCapacity };
+    Utils::UnorderedMap<u64, glm::ivec2> m_PendingRebuilds;
+    //Sectors with at least a chunk changed since it was loaded, with the number of change events
+    Utils::UnorderedMap<u32, u32> m_ModifiedSectors;
+
+    //Backend used by the last rebuild, see GlCore::g_GreedyMeshing
+    bool m_GreedyMeshingBuilt = false;
+    //State of the benchmark key in the last logic update, the carve runs once per press
+    bool m_BenchmarkKeyDown = false;
+    //Packets recorded by the logic thread and replayed by the render thread, which never reads the chunks.
+    //Mesh updates must all be applied in order, so they travel in a queue tagged with the packet sequence
+    TripleBuffer<RenderPacket> m_RenderPackets;
+    std::atomic<u64> m_RecordedSequence = 0;
+    //Chunk selected by the last logic update, compared with the recorded chunks and never dereferenced
+    const Chunk* m_SelectedChunk = nullptr;
+    //Player position of the last collision correction applied by the render thread
+    glm::vec3 m_CorrectedPosition{ 0.0f };
+    Utils::Vector<ChunkMeshUpdate> m_MeshUpdates;
+    std::mutex m_MeshUpdateMutex;
+    //Render thread only: the pool ranges of every chunk, and the updates taken from the queue
+    //(at the beginning, the ones which did not fit in the pool last frame)
+    Utils::UnorderedMap<u64, ChunkMesh> m_ChunkMeshes;
+    Utils::Vector<ChunkMeshUpdate> m_ReadyUpdates;
+    //Sequence given to the ready updates merged in a newer one of the same chunk
+    static constexpr u64 s_SupersededUpdate = static_cast<u64>(-1);
+    //Chunks farther than the rendering distance by less than this are recorded too, the camera of the
+    //render thread can be ahead of the one of the packet
+    static constexpr f32 s_RecordMargin = 32.0f;
+    //Block triangles of the last frame's scene pass
+    u32 m_RenderedTriangles = 0;
+    u32 m_RenderedWaterRects = 0;
+    //Meshes and records of the chunks which passed the culling of the last scene pass
+    Utils::Vector<std::pair<const ChunkMesh*, const ChunkRenderRecord*>> m_VisibleChunks;
+    //Bounds of the renderable chunks and their indices in the packet, tested as a batch every frame
+    Culling::BoundsBatch m_ChunkBounds;
+    Utils::Vector<u32> m_BoundedChunks;
+    Utils::Vector<u8> m_FrustumVisibility;
+    u32 m_TestedChunks = 0;
+    u32 m_FrustumCulledChunks = 0;
+
+    //Horizon culling data, the order holds the squared distance and the index in m_BoundedChunks
+    Culling::HorizonBuffer m_HorizonBuffer;
+    Utils::Vector<std::pair<f32, u32>> m_HorizonOrder;
+    u32 m_HorizonCulledChunks = 0;
+    f32 m_HorizonMilliseconds = 0.0f;
+
+    //Cave culling data, the lookup maps chunk coordinates to indices in m_BoundedChunks
+    Utils::UnorderedMap<u64, u32> m_BoundedLookup;
+    //One bit for each section of the renderable chunks
+    Utils::Vector<u16> m_ReachedSections;
+    Utils::Vector<CaveStep> m_CaveQueue;
+    u32 m_CaveCulledChunks = 0;
+    f32 m_CaveMilliseconds = 0.0f;
+
+    //CPU occlusion culling, only chunks within s_OccluderDistance are rasterized as occluders
+    static constexpr f32 s_OccluderDistance = 96.0f;
+    static constexpr u32 s_MaxOccluderChunks = 48;
+    Culling::OcclusionBuffer m_OcclusionBuffer;
+    Culling::BoundsBatch m_OccluderBoxes;
+    //Squared distance from the camera and index in m_BoundedChunks
+    Utils::Vector<std::pair<f32, u32>> m_OccluderCandidates;
+    u32 m_OccludedChunks = 0;
+    f32 m_OcclusionMilliseconds = 0.0f;
+
+    //Front to back order of the visible chunks, identified by their registry key since every packet
+    //lists them differently. Kept between frames, so that the next sort starts from an almost sorted sequence
+    struct DrawOrderEntry
+    {
+        f32 distance_squared;
+        u64 key;
+        u32 bounded_index;
+    };
+    static constexpr u32 s_NotDrawn = static_cast<u32>(-1);
+    static constexpr u32 s_MaxInsertedChunks = 32;
+    Utils::Vector<DrawOrderEntry> m_DrawOrder;
+    //Index in m_BoundedChunks of each visible chunk, s_NotDrawn once it is placed in the order
+    Utils::UnorderedMap<u64, u32> m_DrawLookup;
+    //Sorted output of the frame, as indices in m_BoundedChunks
+    Utils::Vector<u32> m_VisibleOrder;
+    GlCore::FragmentCounter m_SceneSamples;
+
+    //Visible chunks computed once per frame by the render thread and shared with the logic thread.
+    //The render thread fills the set which is not published, then swaps the published index
+    std::array<VisibilitySet, 2> m_VisibilitySets;
+    u32 m_PublishedVisibility = 0;
+    std::mutex m_VisibilityMutex;
+    //Copy used by UpdateScene and HandleSelection, stays consistent for a whole logic update
+    VisibilitySet m_LogicVisibility;
+    u64 m_FrameIndex = 0;
+};
+
+template<class Fn>
+void World::ForEachNeighbor(const glm::ivec3& world_pos, Fn&& fn)
+{
+    for (u32 i = 0; i < 6; i++)
+    {
+        const glm::ivec3 neighbor_pos = world_pos + glm::ivec3(Block::NormalForIndex(i));
+        fn(neighbor_pos, GetBlock(neighbor_pos));
+    }
+}
\ No newline at end of file